@@ -0,0 +1,80 @@
+/* Album - the attributes albumattr collects per song and per album
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef ALBUM_H
+#define ALBUM_H
+
+
+#include <String.h>
+
+#include <map>
+
+
+class BBitmap;
+
+// file types as returned by getFileType()
+static const int32 kAudioFile = 1;
+static const int32 kImageFile = 2;
+
+enum cover_kind {
+	kCoverNone = 0,
+	kCoverEmbedded,		// a picture embedded in one of the songs
+	kCoverImage			// an image file in the album directory
+};
+
+// warnings collected while building an album
+enum {
+	kWarningDifferentArtists	= 0x01,
+	kWarningDifferentAlbums		= 0x02,
+	kWarningMissingLength		= 0x04,
+	kWarningMissingYear			= 0x08,
+	kWarningAmbiguousCover		= 0x10
+};
+
+// The strings of both are interned in the arena of the directory that is
+// scanned, and can be compared by their pointers.
+
+struct album_attrs {
+	const char* artist;
+	const char* album;
+	const char* genre;
+	int32 length;
+	int32 min_year;
+	int32 max_year;
+	BBitmap* cover;
+	int32 tracks;
+	uint32 warnings;
+	cover_kind cover_source;
+	BString cover_path;
+};
+
+struct audio_attrs {
+	const char* artist;
+	const char* album;
+	const char* genre;
+	int32 length;
+	int32 year;
+	BBitmap* cover;
+	bool has_cover;		// even if it has not been decoded (yet)
+};
+
+// Sums up the albums of a directory and all of its sub-directories; this
+// is what is written as Collection:* attributes to the directories above
+// the albums, like the one of an artist, or the root of the library.
+
+struct collection_attrs {
+	collection_attrs()
+		: albums(0), length(0), min_year(0), max_year(0), is_album(false),
+		  incomplete(false) {}
+
+	int32 albums;
+	int32 length;
+	int32 min_year;
+	int32 max_year;
+	std::map<BString, int32> genres;	// number of albums per genre
+	bool is_album;						// the directory itself is one
+	bool incomplete;					// a length is missing for lack of time
+};
+
+#endif	// ALBUM_H
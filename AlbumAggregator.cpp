@@ -0,0 +1,607 @@
+/* AlbumAggregator - combines the tracks of a directory into an album
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "AlbumAggregator.h"
+#include "Arena.h"
+#include "EmbeddedCover.h"
+#include "TailTags.h"
+
+#include <Directory.h>
+#include <File.h>
+#include <NodeInfo.h>
+#include <Path.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <taglib/attachedpictureframe.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mpegfile.h>
+
+#include <map>
+#include <vector>
+
+
+static status_t
+read_string_attribute(BNode& node, const char* attribute, char* buffer,
+	size_t size)
+{
+	ssize_t bytesRead = node.ReadAttr(attribute, B_STRING_TYPE, 0, buffer,
+		size - 1);
+	if (bytesRead < B_OK) {
+		buffer[0] = '\0';
+		return bytesRead;
+	}
+
+	buffer[bytesRead] = '\0';
+	return B_OK;
+}
+
+
+/*!	Reads a string attribute into a stack buffer, and interns it in the
+	arena; a missing attribute results in an empty string.
+*/
+static const char*
+intern_attribute(BNode& node, const char* attribute, Arena& arena)
+{
+	char buffer[1024];
+	read_string_attribute(node, attribute, buffer, sizeof(buffer));
+
+	const char* string = arena.Intern(buffer);
+	return string != NULL ? string : "";
+}
+
+
+/*!	Unlike albumattr itself, the library never writes to the files, so
+	files without a MIME type are not identified.
+*/
+static int32
+file_type(BNode& node)
+{
+	BNodeInfo info(&node);
+	char type[B_MIME_TYPE_LENGTH];
+	if (info.GetType(type) != B_OK)
+		return -1;
+
+	if (!strncmp(type, "audio/", 6))
+		return kAudioFile;
+	if (!strncmp(type, "image/", 6))
+		return kImageFile;
+
+	return -1;
+}
+
+
+static int32
+collect_images(BDirectory& directory, BMessage& images)
+{
+	int32 count = 0;
+	BEntry entry;
+
+	directory.Rewind();
+	while (directory.GetNextEntry(&entry) == B_OK) {
+		if (entry.IsDirectory()) {
+			BDirectory subDirectory(&entry);
+			count += collect_images(subDirectory, images);
+			continue;
+		}
+
+		BNode node(&entry);
+		entry_ref ref;
+		if (file_type(node) == kImageFile && entry.GetRef(&ref) == B_OK) {
+			images.AddRef("refs", &ref);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
+static int32
+count_word_occurences(const char* string, const char* word)
+{
+	size_t wordLength = strlen(word);
+	int32 count = 0;
+
+	while (string[0]) {
+		if (!strncasecmp(string, word, wordLength)) {
+			count++;
+			string += wordLength;
+		} else
+			string++;
+	}
+
+	return count;
+}
+
+
+static album_verdict
+finish_album(const AlbumAggregator& aggregator,
+	const aggregator_options& options, album_attrs& album)
+{
+	album_verdict verdict = aggregator.Finish(album);
+	if (verdict == kAlbumMixed && options.allow_mixed) {
+		// "-d" keeps the artist of the first track, only the Tracker
+		// add-on names the artist "Various" when asked to continue
+		if (options.various_artist && aggregator.DifferentArtists())
+			album.artist = aggregator.Various();
+		verdict = kAlbumAccepted;
+	}
+
+	return verdict;
+}
+
+
+static void
+copy_record(const album_attrs& album, album_verdict verdict,
+	album_record& record)
+{
+	record.verdict = verdict;
+	record.artist = album.artist;
+	record.album = album.album;
+	record.genre = album.genre;
+	record.length = album.length;
+	record.min_year = album.min_year;
+	record.max_year = album.max_year;
+	record.tracks = album.tracks;
+	record.warnings = album.warnings;
+	record.cover_source = album.cover_source;
+	record.cover_path = album.cover_path;
+}
+
+
+//	#pragma mark -
+
+
+/*!	All strings are interned in the given \a arena, so that they can be
+	compared by their pointers; the strings of the tracks added may already
+	be interned there, but do not need to be.
+*/
+AlbumAggregator::AlbumAggregator(Arena& arena)
+	:
+	fArena(arena),
+	fEmpty(arena.Intern("")),
+	fSoundtrack(arena.Intern("Soundtrack")),
+	fMisc(arena.Intern("Misc")),
+	fVarious(arena.Intern("Various")),
+	fTracks(0),
+	fUnsampledTracks(0),
+	fDifferentArtists(false),
+	fDifferentAlbums(false)
+{
+	fAlbum.artist = fEmpty;
+	fAlbum.album = fEmpty;
+	fAlbum.genre = fEmpty;
+	fAlbum.length = 0;
+	fAlbum.min_year = 0;
+	fAlbum.max_year = 0;
+	fAlbum.cover = NULL;
+	fAlbum.tracks = 0;
+	fAlbum.warnings = 0;
+	fAlbum.cover_source = kCoverNone;
+}
+
+
+status_t
+AlbumAggregator::InitCheck() const
+{
+	return fEmpty != NULL && fSoundtrack != NULL && fMisc != NULL
+		&& fVarious != NULL ? B_OK : B_NO_MEMORY;
+}
+
+
+/*!	Adds an audio track. If \a name is given, \a path is the directory of
+	the track, and only joined with its name if the path is needed.
+	The cover bitmap of the track, if any, is not owned by the aggregator,
+	but becomes the cover of the album if it is the first one.
+*/
+void
+AlbumAggregator::AddTrack(const audio_attrs& track, const char* path,
+	const char* name)
+{
+	const char* artist = _Intern(track.artist);
+	const char* album = _Intern(track.album);
+	const char* genre = _Intern(track.genre);
+
+	if (fTracks++ == 0) {
+		fAlbum.artist = artist;
+		fAlbum.album = album;
+		fAlbum.min_year = fAlbum.max_year = track.year;
+		fAlbum.genre = genre;
+	} else if (fAlbum.artist != artist)
+		fDifferentArtists = true;
+	else if (fAlbum.album != album)
+		fDifferentAlbums = true;
+
+	if (!strcasecmp(genre, fSoundtrack))
+		fAlbum.genre = fSoundtrack;
+	else if (genre != fAlbum.genre)
+		fAlbum.genre = fMisc;
+
+	// Use the first cover that we find
+	if (fAlbum.cover_source == kCoverNone && track.has_cover) {
+		fAlbum.cover = track.cover;
+		fAlbum.cover_source = kCoverEmbedded;
+		if (name != NULL)
+			fAlbum.cover_path = BPath(path, name).Path();
+		else
+			fAlbum.cover_path = path;
+	}
+
+	if (track.length > 0)
+		fAlbum.length += track.length;
+	else
+		fAlbum.warnings |= kWarningMissingLength;
+
+	if (track.year != 0) {
+		if (track.year > fAlbum.max_year)
+			fAlbum.max_year = track.year;
+		else if (track.year < fAlbum.min_year)
+			fAlbum.min_year = track.year;
+	}
+}
+
+
+/*!	Adds a track of which only the length is known, because it was left
+	out of a sample of the album that agreed on everything else.
+*/
+void
+AlbumAggregator::AddUnsampledTrack(int32 length)
+{
+	fUnsampledTracks++;
+
+	if (length > 0)
+		fAlbum.length += length;
+	else
+		fAlbum.warnings |= kWarningMissingLength;
+}
+
+
+/*!	Fills in the \a album from the tracks added so far. Even if the tracks
+	do not make an album, it is completely filled in, so that the caller
+	can decide to use it anyway; with mixed artists, it should then use
+	Various() as the artist.
+*/
+album_verdict
+AlbumAggregator::Finish(album_attrs& album) const
+{
+	album = fAlbum;
+	album.tracks = CountTracks();
+
+	if (fDifferentArtists)
+		album.warnings |= kWarningDifferentArtists;
+	if (fDifferentAlbums)
+		album.warnings |= kWarningDifferentAlbums;
+	if (album.min_year == 0 || album.max_year == 0)
+		album.warnings |= kWarningMissingYear;
+
+	if (CountTracks() < kMinAlbumTracks)
+		return kAlbumTooFewTracks;
+	if (fDifferentArtists || fDifferentAlbums)
+		return kAlbumMixed;
+
+	return kAlbumAccepted;
+}
+
+
+const char*
+AlbumAggregator::_Intern(const char* string)
+{
+	if (string == NULL)
+		return fEmpty;
+
+	const char* interned = fArena.Intern(string);
+	return interned != NULL ? interned : fEmpty;
+}
+
+
+//	#pragma mark -
+
+
+/*!	Reads the Audio:* and Media:* attributes of a track. Returns
+	B_ENTRY_NOT_FOUND if its length is not known, so that the caller may
+	ask the Media Kit for it.
+*/
+status_t
+read_track_attributes(BNode& node, Arena& arena, audio_attrs& attrs)
+{
+	attrs.artist = intern_attribute(node, "Audio:Artist", arena);
+	attrs.album = intern_attribute(node, "Audio:Album", arena);
+	attrs.genre = intern_attribute(node, "Media:Genre", arena);
+
+	attrs.length = 0;
+	attrs.year = 0;
+
+	if (node.ReadAttr("Media:Year", B_INT32_TYPE, 0, &attrs.year,
+			sizeof(int32)) == sizeof(int32)
+		&& attrs.year != 0 && attrs.year < 100)
+		attrs.year += 1900;
+
+	char length[64];
+	char* seconds;
+	if (read_string_attribute(node, "Media:Length", length, sizeof(length))
+			== B_OK
+		&& (seconds = strchr(length, ':')) != NULL) {
+		attrs.length = atol(length) * 60 + atol(seconds + 1);
+		return B_OK;
+	}
+
+	return B_ENTRY_NOT_FOUND;
+}
+
+
+/*!	Chooses the cover among the image files in \a refs by their names.
+	Returns B_ERROR if there is more than one equally good candidate.
+*/
+status_t
+choose_cover(BMessage& refs, entry_ref& chosen)
+{
+	int32 count;
+	refs.GetInfo("refs", NULL, &count);
+
+	// are there any candidates at all?
+	if (count == 0)
+		return B_ENTRY_NOT_FOUND;
+
+	// if there is only one image, we have a clear candidate
+	if (count == 1)
+		return refs.FindRef("refs", &chosen);
+
+	const char* words[] = {"cover", "front", "album"};
+	int32 wordCount = sizeof(words) / sizeof(const char*);
+
+	const char* stopWords[] = {"back", "cd", "inlay", "inside", "logo",
+		"single", "alternative"};
+	int32 stopWordCount = sizeof(stopWords) / sizeof(const char*);
+
+	int32 score[count];
+	memset(score, 0, sizeof(score));
+
+	// compute the score
+
+	entry_ref ref;
+	for (int32 i = 0; refs.FindRef("refs", i, &ref) == B_OK; i++) {
+		BPath path(&ref);
+		if (path.InitCheck() != B_OK)
+			continue;
+
+		for (int32 j = 0; j < wordCount; j++)
+			score[i] += count_word_occurences(path.Path(), words[j]) * 2;
+
+		// negative words have higher impact
+		for (int32 j = 0; j < stopWordCount; j++)
+			score[i] -= count_word_occurences(path.Path(), stopWords[j]) * 3;
+	}
+
+	// find the entry with the highest score
+
+	int32 bestIndex = 0;
+	int32 bestCount = 1;
+	int32 bestScore = score[0];
+
+	for (int32 i = 1; i < count; i++) {
+		if (bestScore < score[i]) {
+			bestIndex = i;
+			bestScore = score[i];
+			bestCount = 1;
+		} else if (bestScore == score[i])
+			bestCount++;
+	}
+
+	if (bestCount > 1) {
+		// damn, we couldn't decide
+		return B_ERROR;
+	}
+
+	return refs.FindRef("refs", bestIndex, &chosen);
+}
+
+
+/*!	Returns the front cover picture frame of the ID3v2 \a tag, if it has one
+	(the last one, if there are several).
+*/
+TagLib::ID3v2::AttachedPictureFrame*
+find_front_cover(TagLib::ID3v2::Tag* tag)
+{
+	if (tag == NULL)
+		return NULL;
+
+	// one frame can contain multiple images
+	TagLib::ID3v2::FrameList frames = tag->frameList("APIC");
+	TagLib::ID3v2::AttachedPictureFrame* coverFrame = NULL;
+
+	TagLib::ID3v2::FrameList::ConstIterator iterator = frames.begin();
+	for (; iterator != frames.end(); iterator++) {
+		TagLib::ID3v2::AttachedPictureFrame* pictureFrame
+			= static_cast<TagLib::ID3v2::AttachedPictureFrame*>(*iterator);
+		if (pictureFrame->type()
+				== TagLib::ID3v2::AttachedPictureFrame::FrontCover)
+			coverFrame = pictureFrame;
+	}
+
+	return coverFrame;
+}
+
+
+/*!	Returns whether the audio \a file at \a path has a cover embedded in
+	it, using the same rules as albumattr: the picture block of a FLAC or
+	Ogg file, the cover atom of an MP4 file, or else a front cover in its
+	ID3v2 tag. The picture itself is not read.
+*/
+bool
+has_embedded_cover(BFile& file, const char* path)
+{
+	uint8 header[12];
+	ssize_t bytesRead = file.ReadAt(0, header, sizeof(header));
+	container_type type = identify_container(header,
+		bytesRead > 0 ? bytesRead : 0);
+
+	if (type != kContainerUnknown) {
+		embedded_cover cover;
+		if (find_embedded_cover(file, type, cover) != B_OK)
+			return false;
+
+		free(cover.data);
+		return true;
+	}
+
+	TagLib::MPEG::File tagFile(path, false);
+	return find_front_cover(tagFile.ID3v2Tag()) != NULL;
+}
+
+
+static void
+add_track_record(AlbumAggregator& aggregator, const track_record& record)
+{
+	audio_attrs track;
+	track.artist = record.artist;
+	track.album = record.album;
+	track.genre = record.genre;
+	track.length = record.length;
+	track.year = record.year;
+	track.cover = NULL;
+	track.has_cover = record.has_cover;
+
+	aggregator.AddTrack(track, record.path != NULL ? record.path : "");
+}
+
+
+/*!	Makes an album out of the given tracks. The result is returned even
+	if they do not make an album; its verdict tells.
+*/
+status_t
+aggregate_tracks(const track_record* tracks, int32 count,
+	const aggregator_options& options, album_record& record)
+{
+	Arena arena;
+	AlbumAggregator aggregator(arena);
+	status_t status = aggregator.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	for (int32 i = 0; i < count; i++)
+		add_track_record(aggregator, tracks[i]);
+
+	album_attrs album;
+	album_verdict verdict = finish_album(aggregator, options, album);
+	copy_record(album, verdict, record);
+	return B_OK;
+}
+
+
+/*!	Makes albums out of tracks from any number of directories, the way
+	albumattr does when it walks a tree: the tracks are grouped by the
+	directory in their path, in the order the directories first appear,
+	and each group is judged on its own. Up to \a maxAlbums records are
+	filled in; \a albumCount is set to the number of directories found,
+	so that a caller can tell if there was not enough room.
+*/
+status_t
+aggregate_albums(const track_record* tracks, int32 count,
+	const aggregator_options& options, album_record* albums,
+	int32 maxAlbums, int32& albumCount)
+{
+	typedef std::map<BString, int32> GroupMap;
+	GroupMap groups;
+	std::vector<std::vector<int32> > members;
+
+	for (int32 i = 0; i < count; i++) {
+		const char* path = tracks[i].path != NULL ? tracks[i].path : "";
+		const char* slash = strrchr(path, '/');
+		BString directory(path, slash != NULL ? slash - path : 0);
+
+		GroupMap::iterator found = groups.find(directory);
+		if (found == groups.end()) {
+			found = groups.insert(std::make_pair(directory,
+				(int32)members.size())).first;
+			members.push_back(std::vector<int32>());
+		}
+		members[found->second].push_back(i);
+	}
+
+	albumCount = members.size();
+
+	for (int32 group = 0; group < albumCount && group < maxAlbums; group++) {
+		Arena arena;
+		AlbumAggregator aggregator(arena);
+		status_t status = aggregator.InitCheck();
+		if (status != B_OK)
+			return status;
+
+		const std::vector<int32>& indices = members[group];
+		for (size_t i = 0; i < indices.size(); i++)
+			add_track_record(aggregator, tracks[indices[i]]);
+
+		album_attrs album;
+		album_verdict verdict = finish_album(aggregator, options, album);
+		copy_record(album, verdict, albums[group]);
+	}
+
+	return B_OK;
+}
+
+
+/*!	Makes an album out of the audio files in the directory at \a path,
+	from their attributes, and the tags at their end. Neither the Media
+	Kit nor any decoder is used, and nothing is written; if the length of
+	a track is not stored in its attributes, it is reported as missing.
+*/
+status_t
+aggregate_directory(const char* path, const aggregator_options& options,
+	album_record& record)
+{
+	BDirectory directory(path);
+	status_t status = directory.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	Arena arena;
+	AlbumAggregator aggregator(arena);
+	status = aggregator.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	BEntry entry;
+	while (directory.GetNextEntry(&entry) == B_OK) {
+		char name[B_FILE_NAME_LENGTH];
+		BFile file(&entry, B_READ_ONLY);
+		if (file.InitCheck() != B_OK || file_type(file) != kAudioFile
+			|| entry.GetName(name) != B_OK)
+			continue;
+
+		audio_attrs track;
+		track.cover = NULL;
+		track.has_cover = false;
+
+		read_track_attributes(file, arena, track);
+		if (tail_tags_needed(track))
+			read_tail_tags(file, arena, track);
+
+		BPath trackPath(path, name);
+		track.has_cover = has_embedded_cover(file, trackPath.Path());
+
+		aggregator.AddTrack(track, path, name);
+	}
+
+	album_attrs album;
+	album_verdict verdict = finish_album(aggregator, options, album);
+
+	BMessage images;
+	entry_ref coverRef;
+	if (verdict == kAlbumAccepted && album.cover_source == kCoverNone
+		&& options.find_cover_image && collect_images(directory, images) > 0) {
+		if (choose_cover(images, coverRef) == B_OK) {
+			album.cover_source = kCoverImage;
+			album.cover_path = BPath(&coverRef).Path();
+		} else
+			album.warnings |= kWarningAmbiguousCover;
+	}
+
+	copy_record(album, verdict, record);
+	return B_OK;
+}
@@ -0,0 +1,126 @@
+/* AlbumAggregator - combines the tracks of a directory into an album
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef ALBUM_AGGREGATOR_H
+#define ALBUM_AGGREGATOR_H
+
+
+#include "Album.h"
+
+#include <Entry.h>
+#include <Message.h>
+#include <Node.h>
+
+
+class Arena;
+class BFile;
+
+namespace TagLib {
+	namespace ID3v2 {
+		class AttachedPictureFrame;
+		class Tag;
+	}
+}
+
+// a directory needs at least this many tracks to be an album
+static const int32 kMinAlbumTracks = 3;
+
+enum album_verdict {
+	kAlbumAccepted = 0,
+	kAlbumTooFewTracks,
+	kAlbumMixed			// the artist or album differs from track to track
+};
+
+struct aggregator_options {
+	aggregator_options()
+		: allow_mixed(false), various_artist(false), find_cover_image(true) {}
+
+	bool	allow_mixed;		// accept samplers as albums, like "-d"
+	bool	various_artist;		// and call their artist "Various", like
+								// the "Continue" of the Tracker add-on
+	bool	find_cover_image;	// look for image files without embedded cover
+};
+
+// A track as passed in by users of the library; the strings are copied.
+struct track_record {
+	const char*	path;
+	const char*	artist;
+	const char*	album;
+	const char*	genre;
+	int32		length;			// in seconds
+	int32		year;
+	bool		has_cover;
+};
+
+// An album as returned to users of the library.
+struct album_record {
+	album_verdict	verdict;
+	BString			artist;
+	BString			album;
+	BString			genre;
+	int32			length;
+	int32			min_year;
+	int32			max_year;
+	int32			tracks;
+	uint32			warnings;
+	cover_kind		cover_source;
+	BString			cover_path;
+};
+
+
+/*!	Applies the rules that make an album out of a number of tracks: the
+	artist, album, and year range are taken from the tracks, mixed genres
+	become "Misc" (unless one is a "Soundtrack"), the lengths are summed
+	up, and the first embedded cover is used.
+	It keeps no state besides its own, and can be used from any number of
+	threads at once, as long as each uses its own aggregator and arena.
+*/
+class AlbumAggregator {
+	public:
+		AlbumAggregator(Arena& arena);
+
+		status_t InitCheck() const;
+
+		void AddTrack(const audio_attrs& track, const char* path,
+					const char* name = NULL);
+		void AddUnsampledTrack(int32 length);
+		int32 CountTracks() const { return fTracks + fUnsampledTracks; }
+		BBitmap* Cover() const { return fAlbum.cover; }
+
+		bool DifferentArtists() const { return fDifferentArtists; }
+		bool DifferentAlbums() const { return fDifferentAlbums; }
+		const char* Various() const { return fVarious; }
+
+		album_verdict Finish(album_attrs& album) const;
+
+	private:
+		const char* _Intern(const char* string);
+
+		Arena&		fArena;
+		const char*	fEmpty;
+		const char*	fSoundtrack;
+		const char*	fMisc;
+		const char*	fVarious;
+		album_attrs	fAlbum;
+		int32		fTracks;
+		int32		fUnsampledTracks;
+		bool		fDifferentArtists;
+		bool		fDifferentAlbums;
+};
+
+
+status_t read_track_attributes(BNode& node, Arena& arena, audio_attrs& attrs);
+status_t choose_cover(BMessage& refs, entry_ref& chosen);
+TagLib::ID3v2::AttachedPictureFrame* find_front_cover(TagLib::ID3v2::Tag* tag);
+bool has_embedded_cover(BFile& file, const char* path);
+
+status_t aggregate_tracks(const track_record* tracks, int32 count,
+	const aggregator_options& options, album_record& album);
+status_t aggregate_albums(const track_record* tracks, int32 count,
+	const aggregator_options& options, album_record* albums,
+	int32 maxAlbums, int32& albumCount);
+status_t aggregate_directory(const char* path,
+	const aggregator_options& options, album_record& album);
+
+#endif	// ALBUM_AGGREGATOR_H
@@ -0,0 +1,215 @@
+/* Arena - per album memory, and an interning table for its strings
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Arena.h"
+
+#include <stdlib.h>
+
+
+static const size_t kBlockSize = 16384;
+static const uint32 kInitialTableSize = 64;
+
+
+static uint32
+hash_string(const char* string, size_t length)
+{
+	// FNV-1a
+	uint32 hash = 2166136261U;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (uint8)string[i];
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+
+static inline size_t
+align(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+
+//	#pragma mark -
+
+
+ArenaCache::ArenaCache()
+	:
+	fBlocks(NULL),
+	fAllocations(0)
+{
+}
+
+
+ArenaCache::~ArenaCache()
+{
+	while (fBlocks != NULL) {
+		void* next = *(void**)fBlocks;
+		free(fBlocks);
+		fBlocks = next;
+	}
+}
+
+
+//	#pragma mark -
+
+
+Arena::Arena(ArenaCache* cache)
+	:
+	fCache(cache),
+	fBlocks(NULL),
+	fTable(NULL),
+	fTableSize(0),
+	fCount(0)
+{
+}
+
+
+Arena::~Arena()
+{
+	while (fBlocks != NULL) {
+		block* next = fBlocks->next;
+
+		if (fCache != NULL) {
+			fBlocks->next = (block*)fCache->fBlocks;
+			fCache->fBlocks = fBlocks;
+		} else
+			free(fBlocks);
+
+		fBlocks = next;
+	}
+}
+
+
+void*
+Arena::Allocate(size_t size)
+{
+	size = align(size);
+
+	if (fBlocks == NULL || fBlocks->used + size > fBlocks->size) {
+		if (_AddBlock(size) == NULL)
+			return NULL;
+	}
+
+	void* memory = (uint8*)fBlocks + fBlocks->used;
+	fBlocks->used += size;
+	return memory;
+}
+
+
+/*!	Returns the interned copy of the \a length bytes at \a string; the
+	copy is NUL terminated. Returns NULL if there is not enough memory.
+*/
+const char*
+Arena::Intern(const char* string, size_t length)
+{
+	if (fCount * 2 >= fTableSize && !_GrowTable())
+		return NULL;
+
+	uint32 mask = fTableSize - 1;
+	uint32 index = hash_string(string, length) & mask;
+
+	while (fTable[index] != NULL) {
+		const char* interned = fTable[index];
+		if (!memcmp(interned, string, length) && interned[length] == '\0')
+			return interned;
+
+		index = (index + 1) & mask;
+	}
+
+	char* copy = (char*)Allocate(length + 1);
+	if (copy == NULL)
+		return NULL;
+
+	memcpy(copy, string, length);
+	copy[length] = '\0';
+
+	fTable[index] = copy;
+	fCount++;
+	return copy;
+}
+
+
+/*!	Returns a copy of \a string, without interning it. */
+const char*
+Arena::Copy(const char* string)
+{
+	size_t length = strlen(string);
+	char* copy = (char*)Allocate(length + 1);
+	if (copy != NULL)
+		memcpy(copy, string, length + 1);
+
+	return copy;
+}
+
+
+Arena::block*
+Arena::_AddBlock(size_t size)
+{
+	size += align(sizeof(block));
+
+	// look for a large enough block in the cache first
+
+	block* cached = NULL;
+	if (fCache != NULL) {
+		block** last = (block**)&fCache->fBlocks;
+		cached = (block*)fCache->fBlocks;
+		while (cached != NULL && cached->size < size) {
+			last = &cached->next;
+			cached = cached->next;
+		}
+
+		if (cached != NULL)
+			*last = cached->next;
+	}
+
+	if (cached == NULL) {
+		if (size < kBlockSize)
+			size = kBlockSize;
+
+		cached = (block*)malloc(size);
+		if (cached == NULL)
+			return NULL;
+
+		cached->size = size;
+		if (fCache != NULL)
+			fCache->fAllocations++;
+	}
+
+	cached->used = align(sizeof(block));
+	cached->next = fBlocks;
+	fBlocks = cached;
+	return cached;
+}
+
+
+bool
+Arena::_GrowTable()
+{
+	uint32 size = fTableSize > 0 ? fTableSize * 2 : kInitialTableSize;
+	const char** table = (const char**)Allocate(size * sizeof(const char*));
+	if (table == NULL)
+		return false;
+
+	memset(table, 0, size * sizeof(const char*));
+
+	// the old table stays in the arena until it is destroyed
+	for (uint32 i = 0; i < fTableSize; i++) {
+		if (fTable[i] == NULL)
+			continue;
+
+		uint32 index = hash_string(fTable[i], strlen(fTable[i])) & (size - 1);
+		while (table[index] != NULL)
+			index = (index + 1) & (size - 1);
+
+		table[index] = fTable[i];
+	}
+
+	fTable = table;
+	fTableSize = size;
+	return true;
+}
@@ -0,0 +1,119 @@
+/* Arena - per album memory, and an interning table for its strings
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <SupportDefs.h>
+
+#include <string.h>
+
+
+/*!	Keeps the memory blocks of destroyed arenas for the next ones, so that
+	the arenas of album after album no longer need new blocks from the
+	heap once the cache has grown large enough. This only covers what is
+	stored in the arenas: TagLib, the Storage Kit, and the Media Kit still
+	allocate memory of their own.
+	A cache must only be used by one thread at a time; the blocks are
+	freed when it is deleted.
+*/
+class ArenaCache {
+	public:
+		ArenaCache();
+		~ArenaCache();
+
+		// the number of blocks that had to be allocated from the heap
+		int64 CountAllocations() const { return fAllocations; }
+
+	private:
+		friend class Arena;
+
+		void*		fBlocks;
+		int64		fAllocations;
+};
+
+
+/*!	Hands out memory for the lifetime of the arena, which is usually the
+	scan of one directory. Without a \a cache, its memory blocks are freed
+	when it is destroyed; otherwise, they are given to the cache.
+	Strings can be interned: the same string is only stored once, and is
+	always returned as the same pointer, so that interned strings can be
+	compared by their pointers.
+*/
+class Arena {
+	public:
+		Arena(ArenaCache* cache = NULL);
+		~Arena();
+
+		void* Allocate(size_t size);
+
+		const char* Intern(const char* string, size_t length);
+		const char* Intern(const char* string)
+					{ return Intern(string, strlen(string)); }
+		const char* Copy(const char* string);
+
+	private:
+		struct block {
+			block*	next;
+			size_t	size;
+			size_t	used;
+		};
+
+		block* _AddBlock(size_t size);
+		bool _GrowTable();
+
+		ArenaCache*		fCache;
+		block*			fBlocks;
+		const char**	fTable;
+		uint32			fTableSize;
+		uint32			fCount;
+};
+
+
+/*!	A growing array of plain old data that lives in an arena. */
+template<typename Type>
+class ArenaList {
+	public:
+		ArenaList(Arena& arena)
+			:
+			fArena(arena),
+			fItems(NULL),
+			fCount(0),
+			fCapacity(0)
+		{
+		}
+
+		Type* Add()
+		{
+			if (fCount == fCapacity) {
+				int32 capacity = fCapacity > 0 ? fCapacity * 2 : 32;
+				Type* items = (Type*)fArena.Allocate(capacity * sizeof(Type));
+				if (items == NULL)
+					return NULL;
+
+				if (fCount > 0)
+					memcpy(items, fItems, fCount * sizeof(Type));
+
+				fItems = items;
+				fCapacity = capacity;
+			}
+
+			Type* item = &fItems[fCount++];
+			memset(item, 0, sizeof(Type));
+			return item;
+		}
+
+		int32 Count() const { return fCount; }
+		Type* Items() { return fItems; }
+		Type& operator[](int32 index) { return fItems[index]; }
+
+	private:
+		Arena&	fArena;
+		Type*	fItems;
+		int32	fCount;
+		int32	fCapacity;
+};
+
+#endif	// ARENA_H
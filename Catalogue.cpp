@@ -0,0 +1,705 @@
+/* Catalogue - a memory mappable file of all albums albumattr has found
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Catalogue.h"
+#include "Album.h"
+
+#include <Autolock.h>
+#include <File.h>
+#include <Locker.h>
+#include <Message.h>
+#include <OS.h>
+#include <String.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+
+struct album_entry {
+	BString	artist;
+	BString	title;
+	BString	genre;
+	BString	cover_path;
+	int32	length;
+	int32	min_year;
+	int32	max_year;
+	int32	tracks;
+	uint16	cover_source;
+	uint16	warnings;
+};
+
+typedef std::map<BString, album_entry> AlbumMap;
+
+class StringTable {
+	public:
+		uint32 Add(const BString& string);
+
+		const std::vector<char>& Data() const { return fData; }
+
+	private:
+		typedef std::map<BString, uint32> OffsetMap;
+
+		std::vector<char>	fData;
+		OffsetMap			fOffsets;
+};
+
+struct ArtistOrder {
+	ArtistOrder(const catalogue_album* albums, const char* strings)
+		:
+		fAlbums(albums),
+		fStrings(strings)
+	{
+	}
+
+	bool operator()(uint32 a, uint32 b) const
+	{
+		const catalogue_album& first = fAlbums[a];
+		const catalogue_album& second = fAlbums[b];
+
+		int compare = strcasecmp(fStrings + first.artist,
+			fStrings + second.artist);
+		if (compare == 0) {
+			compare = strcasecmp(fStrings + first.title,
+				fStrings + second.title);
+		}
+		if (compare == 0)
+			compare = strcmp(fStrings + first.path, fStrings + second.path);
+
+		return compare < 0;
+	}
+
+	const catalogue_album*	fAlbums;
+	const char*				fStrings;
+};
+
+struct YearOrder {
+	YearOrder(const catalogue_album* albums, const char* strings)
+		:
+		fAlbums(albums),
+		fArtistOrder(albums, strings)
+	{
+	}
+
+	bool operator()(uint32 a, uint32 b) const
+	{
+		if (fAlbums[a].min_year != fAlbums[b].min_year)
+			return fAlbums[a].min_year < fAlbums[b].min_year;
+
+		return fArtistOrder(a, b);
+	}
+
+	const catalogue_album*	fAlbums;
+	ArtistOrder				fArtistOrder;
+};
+
+
+/*	Until the catalogue is written at the end of the run, every directory
+	visited and every album found is also appended to a log next to it,
+	as a flattened message with a single write(). When an interrupted run
+	is resumed, the directories it has done are skipped, so their albums
+	are taken from the log instead; a record that was only partially
+	written is ignored.
+*/
+
+static const uint32 kMsgCatalogueAlbum = 'pCAl';
+static const uint32 kMsgCatalogueVisit = 'pCVi';
+static const bigtime_t kSyncInterval = 1000000;
+
+static BString sPath;
+static bool sEnabled;
+static AlbumMap sAlbums;
+static std::set<BString> sVisited;
+static BLocker sLock("catalogue");
+static BString sLogPath;
+static int sLogFD = -1;
+static bigtime_t sLastSync;
+
+
+uint32
+StringTable::Add(const BString& string)
+{
+	OffsetMap::iterator found = fOffsets.find(string);
+	if (found != fOffsets.end())
+		return found->second;
+
+	uint32 offset = fData.size();
+	fData.insert(fData.end(), string.String(),
+		string.String() + string.Length() + 1);
+
+	fOffsets.insert(std::make_pair(string, offset));
+	return offset;
+}
+
+
+static void
+load_log()
+{
+	BFile file(sLogPath.String(), B_READ_ONLY);
+	if (file.InitCheck() != B_OK)
+		return;
+
+	BMessage record;
+	while (record.Unflatten(&file) == B_OK) {
+		const char* path;
+		if (record.FindString("path", &path) != B_OK)
+			continue;
+
+		if (record.what == kMsgCatalogueVisit) {
+			sVisited.insert(path);
+			continue;
+		}
+		if (record.what != kMsgCatalogueAlbum)
+			continue;
+
+		album_entry& entry = sAlbums[path];
+		record.FindString("artist", &entry.artist);
+		record.FindString("title", &entry.title);
+		record.FindString("genre", &entry.genre);
+		record.FindString("cover path", &entry.cover_path);
+		record.FindInt32("length", &entry.length);
+		record.FindInt32("min year", &entry.min_year);
+		record.FindInt32("max year", &entry.max_year);
+		record.FindInt32("tracks", &entry.tracks);
+
+		int32 value;
+		if (record.FindInt32("cover source", &value) == B_OK)
+			entry.cover_source = value;
+		if (record.FindInt32("warnings", &value) == B_OK)
+			entry.warnings = value;
+	}
+}
+
+
+static void
+append_to_log(const BMessage& record)
+{
+	if (sLogFD < 0)
+		return;
+
+	ssize_t size = record.FlattenedSize();
+	char* buffer = (char*)malloc(size);
+	if (buffer == NULL)
+		return;
+
+	if (record.Flatten(buffer, size) == B_OK
+		&& write(sLogFD, buffer, size) != size) {
+		fprintf(stderr, "albumattr: could not write catalogue log: %s\n",
+			strerror(errno));
+		close(sLogFD);
+		sLogFD = -1;
+	}
+
+	free(buffer);
+
+	bigtime_t now = system_time();
+	if (sLogFD >= 0 && now - sLastSync >= kSyncInterval) {
+		fsync(sLogFD);
+		sLastSync = now;
+	}
+}
+
+
+static size_t
+align_offset(size_t offset)
+{
+	return (offset + 7) & ~(size_t)7;
+}
+
+
+static status_t
+write_fully(int fd, const void* data, size_t size, off_t offset)
+{
+	while (size > 0) {
+		ssize_t written = pwrite(fd, data, size, offset);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		data = (const uint8*)data + written;
+		size -= written;
+		offset += written;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Adds the albums from the existing catalogue that were not part of
+	this run, so that scanning a subset of the library updates the
+	catalogue instead of replacing it.
+*/
+static void
+merge_existing()
+{
+	Catalogue catalogue;
+	if (catalogue.Open(sPath.String()) != B_OK)
+		return;
+
+	for (int32 i = 0; i < catalogue.CountAlbums(); i++) {
+		const catalogue_album* album = catalogue.AlbumAt(i);
+		BString path = catalogue.StringAt(album->path);
+
+		if (sVisited.find(path) != sVisited.end()
+			|| sAlbums.find(path) != sAlbums.end())
+			continue;
+
+		album_entry& entry = sAlbums[path];
+		entry.artist = catalogue.StringAt(album->artist);
+		entry.title = catalogue.StringAt(album->title);
+		entry.genre = catalogue.StringAt(album->genre);
+		entry.cover_path = catalogue.StringAt(album->cover_path);
+		entry.length = album->length;
+		entry.min_year = album->min_year;
+		entry.max_year = album->max_year;
+		entry.tracks = album->tracks;
+		entry.cover_source = album->cover_source;
+		entry.warnings = album->warnings;
+	}
+}
+
+
+static status_t
+write_catalogue()
+{
+	StringTable strings;
+	strings.Add("");
+
+	std::vector<catalogue_album> albums;
+	albums.reserve(sAlbums.size());
+
+	for (AlbumMap::const_iterator iterator = sAlbums.begin();
+			iterator != sAlbums.end(); iterator++) {
+		const album_entry& entry = iterator->second;
+
+		catalogue_album album;
+		memset(&album, 0, sizeof(album));
+		album.path = strings.Add(iterator->first);
+		album.artist = strings.Add(entry.artist);
+		album.title = strings.Add(entry.title);
+		album.genre = strings.Add(entry.genre);
+		album.cover_path = strings.Add(entry.cover_path);
+		album.length = entry.length;
+		album.min_year = entry.min_year;
+		album.max_year = entry.max_year;
+		album.tracks = entry.tracks;
+		album.cover_source = entry.cover_source;
+		album.warnings = entry.warnings;
+
+		albums.push_back(album);
+	}
+
+	const std::vector<char>& table = strings.Data();
+	const catalogue_album* albumData = albums.empty() ? NULL : &albums[0];
+
+	std::vector<uint32> artistIndex(albums.size());
+	std::vector<uint32> yearIndex(albums.size());
+	for (uint32 i = 0; i < albums.size(); i++)
+		artistIndex[i] = yearIndex[i] = i;
+
+	std::sort(artistIndex.begin(), artistIndex.end(),
+		ArtistOrder(albumData, &table[0]));
+	std::sort(yearIndex.begin(), yearIndex.end(),
+		YearOrder(albumData, &table[0]));
+
+	catalogue_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = kCatalogueMagic;
+	header.version = kCatalogueVersion;
+	header.album_count = albums.size();
+	header.string_table_size = table.size();
+	header.albums_offset = align_offset(sizeof(catalogue_header));
+	header.strings_offset = align_offset(header.albums_offset
+		+ albums.size() * sizeof(catalogue_album));
+	header.artist_index_offset = align_offset(header.strings_offset
+		+ table.size());
+	header.year_index_offset = align_offset(header.artist_index_offset
+		+ albums.size() * sizeof(uint32));
+
+	// write to a temporary file first, and replace the catalogue with it
+	// only when everything has been written
+
+	BString tempPath = sPath;
+	tempPath << ".tmp";
+
+	int fd = open(tempPath.String(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return errno;
+
+	status_t status = write_fully(fd, &header, sizeof(header), 0);
+	if (status == B_OK && !albums.empty()) {
+		status = write_fully(fd, &albums[0],
+			albums.size() * sizeof(catalogue_album), header.albums_offset);
+	}
+	if (status == B_OK) {
+		status = write_fully(fd, &table[0], table.size(),
+			header.strings_offset);
+	}
+	if (status == B_OK && !albums.empty()) {
+		status = write_fully(fd, &artistIndex[0],
+			artistIndex.size() * sizeof(uint32), header.artist_index_offset);
+	}
+	if (status == B_OK && !albums.empty()) {
+		status = write_fully(fd, &yearIndex[0],
+			yearIndex.size() * sizeof(uint32), header.year_index_offset);
+	}
+	if (status == B_OK && fsync(fd) != 0)
+		status = errno;
+
+	close(fd);
+
+	if (status == B_OK && rename(tempPath.String(), sPath.String()) != 0)
+		status = errno;
+	if (status != B_OK)
+		unlink(tempPath.String());
+
+	return status;
+}
+
+
+//	#pragma mark -
+
+
+Catalogue::Catalogue()
+	:
+	fData(NULL),
+	fSize(0),
+	fHeader(NULL),
+	fAlbums(NULL),
+	fStrings(NULL),
+	fArtistIndex(NULL),
+	fYearIndex(NULL)
+{
+}
+
+
+Catalogue::~Catalogue()
+{
+	Close();
+}
+
+
+status_t
+Catalogue::Open(const char* path)
+{
+	Close();
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return errno;
+
+	struct stat stat;
+	if (fstat(fd, &stat) != 0) {
+		close(fd);
+		return errno;
+	}
+
+	if (stat.st_size < (off_t)sizeof(catalogue_header)) {
+		close(fd);
+		return B_BAD_DATA;
+	}
+
+	void* data = mmap(NULL, stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return errno;
+
+	fData = (uint8*)data;
+	fSize = stat.st_size;
+	fHeader = (const catalogue_header*)fData;
+
+	// make sure all sections are within the file, so that the accessors
+	// only need to check the record numbers and string offsets
+
+	uint64 count = fHeader->album_count;
+	if (fHeader->magic != kCatalogueMagic
+		|| fHeader->version != kCatalogueVersion
+		|| fHeader->albums_offset + count * sizeof(catalogue_album) > fSize
+		|| fHeader->strings_offset + fHeader->string_table_size > fSize
+		|| fHeader->string_table_size == 0
+		|| fHeader->artist_index_offset + count * sizeof(uint32) > fSize
+		|| fHeader->year_index_offset + count * sizeof(uint32) > fSize
+		|| (fHeader->albums_offset & 7) != 0
+		|| (fHeader->artist_index_offset & 3) != 0
+		|| (fHeader->year_index_offset & 3) != 0) {
+		Close();
+		return B_BAD_DATA;
+	}
+
+	fAlbums = (const catalogue_album*)(fData + fHeader->albums_offset);
+	fStrings = (const char*)fData + fHeader->strings_offset;
+	fArtistIndex = (const uint32*)(fData + fHeader->artist_index_offset);
+	fYearIndex = (const uint32*)(fData + fHeader->year_index_offset);
+
+	if (fStrings[fHeader->string_table_size - 1] != '\0') {
+		Close();
+		return B_BAD_DATA;
+	}
+
+	return B_OK;
+}
+
+
+void
+Catalogue::Close()
+{
+	if (fData != NULL)
+		munmap(fData, fSize);
+
+	fData = NULL;
+	fSize = 0;
+	fHeader = NULL;
+	fAlbums = NULL;
+	fStrings = NULL;
+	fArtistIndex = NULL;
+	fYearIndex = NULL;
+}
+
+
+int32
+Catalogue::CountAlbums() const
+{
+	return fHeader != NULL ? fHeader->album_count : 0;
+}
+
+
+const catalogue_album*
+Catalogue::AlbumAt(int32 index) const
+{
+	if (index < 0 || index >= CountAlbums())
+		return NULL;
+
+	return &fAlbums[index];
+}
+
+
+const char*
+Catalogue::StringAt(uint32 offset) const
+{
+	if (fHeader == NULL || offset >= fHeader->string_table_size)
+		return "";
+
+	return fStrings + offset;
+}
+
+
+const catalogue_album*
+Catalogue::AlbumByArtistAt(int32 index) const
+{
+	if (index < 0 || index >= CountAlbums())
+		return NULL;
+
+	return AlbumAt(fArtistIndex[index]);
+}
+
+
+const catalogue_album*
+Catalogue::AlbumByYearAt(int32 index) const
+{
+	if (index < 0 || index >= CountAlbums())
+		return NULL;
+
+	return AlbumAt(fYearIndex[index]);
+}
+
+
+/*!	Returns the position of the first album of \a artist in the artist
+	index (case insensitive), or -1 if there is none. The number of albums
+	of that artist is returned in \a _count.
+*/
+int32
+Catalogue::FindArtist(const char* artist, int32* _count) const
+{
+	int32 first = 0;
+	int32 last = CountAlbums();
+
+	// lower bound
+	while (first < last) {
+		int32 middle = (first + last) / 2;
+		const catalogue_album* album = AlbumByArtistAt(middle);
+		if (album != NULL && strcasecmp(StringAt(album->artist), artist) < 0)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	int32 end = first;
+	while (end < CountAlbums()) {
+		const catalogue_album* album = AlbumByArtistAt(end);
+		if (album == NULL || strcasecmp(StringAt(album->artist), artist) != 0)
+			break;
+		end++;
+	}
+
+	if (_count != NULL)
+		*_count = end - first;
+
+	return end > first ? first : -1;
+}
+
+
+/*!	Returns the position of the first album in the year index that was
+	released between \a first and \a last (inclusive), or -1 if there is
+	none. The number of matching albums is returned in \a _count.
+*/
+int32
+Catalogue::FindYears(int32 first, int32 last, int32* _count) const
+{
+	int32 low = 0;
+	int32 high = CountAlbums();
+
+	while (low < high) {
+		int32 middle = (low + high) / 2;
+		const catalogue_album* album = AlbumByYearAt(middle);
+		if (album != NULL && album->min_year < first)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	int32 end = low;
+	while (end < CountAlbums()) {
+		const catalogue_album* album = AlbumByYearAt(end);
+		if (album == NULL || album->min_year > last)
+			break;
+		end++;
+	}
+
+	if (_count != NULL)
+		*_count = end - low;
+
+	return end > low ? low : -1;
+}
+
+
+//	#pragma mark -
+
+
+/*!	Starts collecting albums for the catalogue at \a path. If \a resume is
+	true, the albums of the interrupted run are taken over from its log.
+*/
+status_t
+catalogue_open(const char* path, bool resume)
+{
+	sPath = path;
+	sLogPath = path;
+	sLogPath << ".log";
+	sEnabled = true;
+
+	if (resume)
+		load_log();
+
+	sLogFD = open(sLogPath.String(),
+		O_WRONLY | O_CREAT | (resume ? O_APPEND : O_TRUNC), 0644);
+	if (sLogFD < 0)
+		return errno;
+
+	sLastSync = system_time();
+	return B_OK;
+}
+
+
+bool
+catalogue_enabled()
+{
+	return sEnabled;
+}
+
+
+/*!	Remembers that the directory at \a path has been scanned in this run,
+	so that its old catalogue entry can be dropped if it is no album
+	anymore.
+*/
+void
+catalogue_visit(const char* path)
+{
+	if (!sEnabled)
+		return;
+
+	BAutolock _(sLock);
+	sVisited.insert(path);
+
+	BMessage record(kMsgCatalogueVisit);
+	record.AddString("path", path);
+	append_to_log(record);
+}
+
+
+void
+catalogue_add_album(const char* path, const album_attrs& attrs)
+{
+	if (!sEnabled)
+		return;
+
+	BAutolock _(sLock);
+
+	album_entry& entry = sAlbums[path];
+	entry.artist = attrs.artist;
+	entry.title = attrs.album;
+	entry.genre = attrs.genre;
+	entry.cover_path = attrs.cover_path;
+	entry.length = attrs.length;
+	entry.min_year = attrs.min_year;
+	entry.max_year = attrs.max_year;
+	entry.tracks = attrs.tracks;
+	entry.cover_source = attrs.cover_source;
+	entry.warnings = attrs.warnings;
+
+	BMessage record(kMsgCatalogueAlbum);
+	record.AddString("path", path);
+	record.AddString("artist", entry.artist);
+	record.AddString("title", entry.title);
+	record.AddString("genre", entry.genre);
+	record.AddString("cover path", entry.cover_path);
+	record.AddInt32("length", entry.length);
+	record.AddInt32("min year", entry.min_year);
+	record.AddInt32("max year", entry.max_year);
+	record.AddInt32("tracks", entry.tracks);
+	record.AddInt32("cover source", entry.cover_source);
+	record.AddInt32("warnings", entry.warnings);
+	append_to_log(record);
+}
+
+
+/*!	Merges the albums of this run with the existing catalogue, and
+	replaces the catalogue file with the result. The log is only removed
+	once the catalogue has been written.
+*/
+status_t
+catalogue_close()
+{
+	if (!sEnabled)
+		return B_OK;
+
+	merge_existing();
+	status_t status = write_catalogue();
+
+	if (sLogFD >= 0) {
+		close(sLogFD);
+		sLogFD = -1;
+	}
+	if (status == B_OK)
+		unlink(sLogPath.String());
+
+	sAlbums.clear();
+	sVisited.clear();
+	sEnabled = false;
+	return status;
+}
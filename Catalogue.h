@@ -0,0 +1,90 @@
+/* Catalogue - a memory mappable file of all albums albumattr has found
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef CATALOGUE_H
+#define CATALOGUE_H
+
+
+#include <SupportDefs.h>
+
+
+struct album_attrs;
+
+/*	The catalogue file consists of a header, followed by the album records,
+	the string table, and two indexes. All values are stored in host byte
+	order; a reader recognizes a foreign byte order by the magic.
+	All strings are NUL terminated and stored only once in the string
+	table; they are referenced by their offset in it.
+	The indexes contain album record numbers: the artist index is sorted
+	by artist, title, and path, the year index is sorted by the first
+	year, artist, and title.
+	The file is always replaced as a whole, so that readers that have it
+	mapped keep a consistent view.
+*/
+
+static const uint32 kCatalogueMagic = 'pACt';
+static const uint32 kCatalogueVersion = 1;
+
+struct catalogue_header {
+	uint32	magic;
+	uint32	version;
+	uint32	album_count;
+	uint32	string_table_size;
+	uint64	albums_offset;
+	uint64	strings_offset;
+	uint64	artist_index_offset;
+	uint64	year_index_offset;
+};
+
+struct catalogue_album {
+	uint32	path;
+	uint32	artist;
+	uint32	title;
+	uint32	genre;
+	uint32	cover_path;
+	int32	length;
+	int32	min_year;
+	int32	max_year;
+	int32	tracks;
+	uint16	cover_source;
+	uint16	warnings;
+};
+
+
+class Catalogue {
+	public:
+		Catalogue();
+		~Catalogue();
+
+		status_t Open(const char* path);
+		void Close();
+
+		int32 CountAlbums() const;
+		const catalogue_album* AlbumAt(int32 index) const;
+		const char* StringAt(uint32 offset) const;
+
+		const catalogue_album* AlbumByArtistAt(int32 index) const;
+		const catalogue_album* AlbumByYearAt(int32 index) const;
+
+		int32 FindArtist(const char* artist, int32* _count) const;
+		int32 FindYears(int32 first, int32 last, int32* _count) const;
+
+	private:
+		uint8*			fData;
+		size_t			fSize;
+		const catalogue_header* fHeader;
+		const catalogue_album* fAlbums;
+		const char*		fStrings;
+		const uint32*	fArtistIndex;
+		const uint32*	fYearIndex;
+};
+
+
+status_t catalogue_open(const char* path, bool resume);
+bool catalogue_enabled();
+void catalogue_visit(const char* path);
+void catalogue_add_album(const char* path, const album_attrs& attrs);
+status_t catalogue_close();
+
+#endif	// CATALOGUE_H
@@ -0,0 +1,600 @@
+/* EmbeddedCover - finds the cover picture in FLAC, MP4, and Ogg files
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "EmbeddedCover.h"
+
+#include <ByteOrder.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+
+// the picture type of the front cover, as in ID3v2 APIC frames
+static const uint32 kFrontCover = 3;
+static const uint32 kFLACPictureBlock = 6;
+
+// limits for broken files
+static const int32 kMaxBlocks = 1024;
+static const int32 kMaxAtoms = 4096;
+static const int32 kMaxPages = 1024;
+static const size_t kMaxCommentSize = 16 * 1024 * 1024;
+
+
+static status_t
+read_fully(BPositionIO& io, off_t offset, void* buffer, size_t size)
+{
+	ssize_t bytesRead = io.ReadAt(offset, buffer, size);
+	if (bytesRead < 0)
+		return bytesRead;
+
+	return (size_t)bytesRead == size ? B_OK : B_BAD_DATA;
+}
+
+
+static status_t
+read_be32(BPositionIO& io, off_t offset, off_t end, uint32& value)
+{
+	if (offset + 4 > end)
+		return B_BAD_DATA;
+
+	status_t status = read_fully(io, offset, &value, sizeof(uint32));
+	value = B_BENDIAN_TO_HOST_INT32(value);
+	return status;
+}
+
+
+static bool
+read_le32(const uint8* data, size_t size, size_t& offset, uint32& value)
+{
+	if (offset + 4 > size)
+		return false;
+
+	value = data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16)
+		| ((uint32)data[offset + 3] << 24);
+	offset += 4;
+	return true;
+}
+
+
+static int32
+base64_value(char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	if (c == '+')
+		return 62;
+	if (c == '/')
+		return 63;
+
+	return -1;
+}
+
+
+/*!	Decodes \a length base64 characters into a malloc()ed buffer. */
+static uint8*
+base64_decode(const char* string, size_t length, size_t& _size)
+{
+	uint8* data = (uint8*)malloc(length / 4 * 3 + 3);
+	if (data == NULL)
+		return NULL;
+
+	size_t size = 0;
+	uint32 bits = 0;
+	int32 count = 0;
+
+	for (size_t i = 0; i < length && string[i] != '='; i++) {
+		int32 value = base64_value(string[i]);
+		if (value < 0)
+			continue;
+
+		bits = (bits << 6) | value;
+		if (++count == 4) {
+			data[size++] = bits >> 16;
+			data[size++] = bits >> 8;
+			data[size++] = bits;
+			bits = 0;
+			count = 0;
+		}
+	}
+
+	if (count == 3) {
+		data[size++] = bits >> 10;
+		data[size++] = bits >> 2;
+	} else if (count == 2)
+		data[size++] = bits >> 4;
+
+	_size = size;
+	return data;
+}
+
+
+/*!	Parses the picture structure that FLAC uses in its PICTURE blocks, and
+	that is also stored in the METADATA_BLOCK_PICTURE comments of Ogg
+	files, in the region from \a offset to \a end of \a io.
+*/
+static status_t
+parse_picture(BPositionIO& io, off_t offset, off_t end, uint32& _type,
+	embedded_cover& cover)
+{
+	uint32 type;
+	status_t status = read_be32(io, offset, end, type);
+	if (status != B_OK)
+		return status;
+
+	offset += 4;
+
+	// skip the MIME type, and the description
+	for (int32 i = 0; i < 2; i++) {
+		uint32 length;
+		status = read_be32(io, offset, end, length);
+		if (status != B_OK)
+			return status;
+
+		offset += 4 + (off_t)length;
+	}
+
+	// skip width, height, color depth, and number of colors
+	offset += 16;
+
+	uint32 size;
+	status = read_be32(io, offset, end, size);
+	if (status != B_OK)
+		return status;
+
+	offset += 4;
+	if (size == 0 || offset + (off_t)size > end)
+		return B_BAD_DATA;
+
+	_type = type;
+	cover.offset = offset;
+	cover.size = size;
+	cover.data = NULL;
+	return B_OK;
+}
+
+
+static status_t
+find_flac_cover(BPositionIO& file, off_t fileSize, embedded_cover& cover)
+{
+	off_t offset = 4;
+	bool found = false;
+
+	for (int32 i = 0; i < kMaxBlocks; i++) {
+		uint32 header;
+		status_t status = read_be32(file, offset, fileSize, header);
+		if (status != B_OK)
+			break;
+
+		bool last = (header & 0x80000000) != 0;
+		uint32 type = (header >> 24) & 0x7f;
+		off_t length = header & 0xffffff;
+		offset += 4;
+
+		if (type == kFLACPictureBlock) {
+			embedded_cover candidate;
+			uint32 pictureType;
+			if (parse_picture(file, offset, offset + length, pictureType,
+					candidate) == B_OK
+				&& (!found || pictureType == kFrontCover)) {
+				cover = candidate;
+				found = true;
+
+				if (pictureType == kFrontCover)
+					break;
+			}
+		}
+
+		if (last)
+			break;
+
+		offset += length;
+	}
+
+	return found ? B_OK : B_ENTRY_NOT_FOUND;
+}
+
+
+/*!	Looks for an atom of the given \a type in the region from \a start to
+	\a end, and returns the region of its contents.
+*/
+static status_t
+find_atom(BPositionIO& file, off_t start, off_t end, uint32 type,
+	off_t& _start, off_t& _end)
+{
+	off_t offset = start;
+
+	for (int32 i = 0; i < kMaxAtoms && offset + 8 <= end; i++) {
+		uint32 header[2];
+		status_t status = read_fully(file, offset, header, sizeof(header));
+		if (status != B_OK)
+			return status;
+
+		off_t size = B_BENDIAN_TO_HOST_INT32(header[0]);
+		uint32 atomType = B_BENDIAN_TO_HOST_INT32(header[1]);
+		off_t headerSize = 8;
+
+		if (size == 1) {
+			// a 64 bit size follows
+			uint64 largeSize;
+			status = read_fully(file, offset + 8, &largeSize, sizeof(uint64));
+			if (status != B_OK)
+				return status;
+
+			size = B_BENDIAN_TO_HOST_INT64(largeSize);
+			headerSize = 16;
+		} else if (size == 0) {
+			// the atom extends to the end
+			size = end - offset;
+		}
+
+		if (size < headerSize || offset + size > end)
+			return B_BAD_DATA;
+
+		if (atomType == type) {
+			_start = offset + headerSize;
+			_end = offset + size;
+			return B_OK;
+		}
+
+		// this also skips the audio data without reading it
+		offset += size;
+	}
+
+	return B_ENTRY_NOT_FOUND;
+}
+
+
+static status_t
+find_mp4_cover(BPositionIO& file, off_t fileSize, embedded_cover& cover)
+{
+	static const uint32 kPath[] = {'moov', 'udta', 'meta', 'ilst', 'covr',
+		'data'};
+
+	off_t start = 0;
+	off_t end = fileSize;
+
+	for (size_t i = 0; i < sizeof(kPath) / sizeof(kPath[0]); i++) {
+		off_t childStart;
+		off_t childEnd;
+		status_t status = find_atom(file, start, end, kPath[i], childStart,
+			childEnd);
+		if (status != B_OK)
+			return status;
+
+		start = childStart;
+		end = childEnd;
+
+		if (kPath[i] == 'meta') {
+			// usually a "full" atom, with version and flags first
+			uint32 versionAndFlags;
+			if (read_be32(file, start, end, versionAndFlags) == B_OK
+				&& versionAndFlags == 0)
+				start += 4;
+		}
+	}
+
+	// the data atom starts with the type of its data, and a locale
+	start += 8;
+	if (start >= end)
+		return B_BAD_DATA;
+
+	cover.offset = start;
+	cover.size = end - start;
+	cover.data = NULL;
+	return B_OK;
+}
+
+
+static status_t
+append_region(BPositionIO& file, off_t offset, size_t size, uint8*& data,
+	size_t& dataSize)
+{
+	if (size == 0)
+		return B_OK;
+	if (dataSize + size > kMaxCommentSize)
+		return B_BAD_DATA;
+
+	uint8* newData = (uint8*)realloc(data, dataSize + size);
+	if (newData == NULL)
+		return B_NO_MEMORY;
+
+	data = newData;
+	status_t status = read_fully(file, offset, data + dataSize, size);
+	if (status == B_OK)
+		dataSize += size;
+
+	return status;
+}
+
+
+/*!	Reads the second packet of the first logical stream of an Ogg file;
+	both with Vorbis and Opus, this contains the comments. The pages that
+	follow it are not read at all.
+*/
+static status_t
+read_ogg_comments(BPositionIO& file, uint8*& _data, size_t& _size)
+{
+	uint8* data = NULL;
+	size_t size = 0;
+	off_t offset = 0;
+	uint32 serial = 0;
+	int32 packet = 0;
+	status_t status = B_ENTRY_NOT_FOUND;
+
+	for (int32 page = 0; page < kMaxPages; page++) {
+		uint8 header[27];
+		status = read_fully(file, offset, header, sizeof(header));
+		if (status != B_OK)
+			break;
+		if (memcmp(header, "OggS", 4)) {
+			status = B_BAD_DATA;
+			break;
+		}
+
+		uint32 pageSerial = header[14] | (header[15] << 8)
+			| (header[16] << 16) | ((uint32)header[17] << 24);
+		if (page == 0)
+			serial = pageSerial;
+
+		uint8 segments[255];
+		uint8 segmentCount = header[26];
+		status = read_fully(file, offset + sizeof(header), segments,
+			segmentCount);
+		if (status != B_OK)
+			break;
+
+		offset += sizeof(header) + segmentCount;
+
+		if (pageSerial != serial) {
+			// a page of another stream
+			for (int32 i = 0; i < segmentCount; i++)
+				offset += segments[i];
+			continue;
+		}
+
+		// collect the segments of the comment packet on this page
+
+		off_t runStart = offset;
+		size_t runSize = 0;
+
+		for (int32 i = 0; i < segmentCount; i++) {
+			if (packet == 1)
+				runSize += segments[i];
+			offset += segments[i];
+
+			if (segments[i] == 255)
+				continue;
+
+			// the end of a packet
+			if (packet == 1) {
+				status = append_region(file, runStart, runSize, data, size);
+				if (status == B_OK) {
+					_data = data;
+					_size = size;
+					return B_OK;
+				}
+				break;
+			}
+
+			packet++;
+			runStart = offset;
+		}
+		if (status != B_OK)
+			break;
+
+		if (packet == 1) {
+			// the packet continues on the next page
+			status = append_region(file, runStart, runSize, data, size);
+			if (status != B_OK)
+				break;
+		}
+	}
+
+	free(data);
+	return status != B_OK ? status : B_ENTRY_NOT_FOUND;
+}
+
+
+static status_t
+find_ogg_cover(BPositionIO& file, embedded_cover& cover)
+{
+	uint8* comments;
+	size_t size;
+	status_t status = read_ogg_comments(file, comments, size);
+	if (status != B_OK)
+		return status;
+
+	size_t offset;
+	if (size >= 7 && !memcmp(comments, "\x03vorbis", 7))
+		offset = 7;
+	else if (size >= 8 && !memcmp(comments, "OpusTags", 8))
+		offset = 8;
+	else {
+		free(comments);
+		return B_ENTRY_NOT_FOUND;
+	}
+
+	static const char kKey[] = "METADATA_BLOCK_PICTURE=";
+	static const size_t kKeyLength = sizeof(kKey) - 1;
+
+	bool found = false;
+	uint32 vendorLength;
+	uint32 count = 0;
+	if (read_le32(comments, size, offset, vendorLength)) {
+		offset += vendorLength;
+		if (!read_le32(comments, size, offset, count))
+			count = 0;
+	}
+
+	for (uint32 i = 0; i < count; i++) {
+		uint32 length;
+		if (!read_le32(comments, size, offset, length)
+			|| offset + length > size)
+			break;
+
+		const char* comment = (const char*)comments + offset;
+		offset += length;
+
+		if (length <= kKeyLength || strncasecmp(comment, kKey, kKeyLength))
+			continue;
+
+		size_t pictureSize;
+		uint8* picture = base64_decode(comment + kKeyLength,
+			length - kKeyLength, pictureSize);
+		if (picture == NULL)
+			continue;
+
+		BMemoryIO memoryIO(picture, pictureSize);
+		embedded_cover candidate;
+		uint32 pictureType;
+		if (parse_picture(memoryIO, 0, pictureSize, pictureType, candidate)
+				== B_OK
+			&& (!found || pictureType == kFrontCover)) {
+			if (found)
+				free(cover.data);
+
+			cover = candidate;
+			cover.data = picture;
+			found = true;
+
+			if (pictureType == kFrontCover)
+				break;
+		} else
+			free(picture);
+	}
+
+	free(comments);
+	return found ? B_OK : B_ENTRY_NOT_FOUND;
+}
+
+
+//	#pragma mark -
+
+
+FileRegionIO::FileRegionIO(BPositionIO* source, off_t offset, off_t size)
+	:
+	fSource(source),
+	fOffset(offset),
+	fSize(size),
+	fPosition(0)
+{
+}
+
+
+ssize_t
+FileRegionIO::ReadAt(off_t position, void* buffer, size_t size)
+{
+	if (position < 0)
+		return B_BAD_VALUE;
+	if (position >= fSize)
+		return 0;
+
+	if ((off_t)size > fSize - position)
+		size = fSize - position;
+
+	return fSource->ReadAt(fOffset + position, buffer, size);
+}
+
+
+ssize_t
+FileRegionIO::WriteAt(off_t position, const void* buffer, size_t size)
+{
+	return B_NOT_ALLOWED;
+}
+
+
+off_t
+FileRegionIO::Seek(off_t position, uint32 seekMode)
+{
+	switch (seekMode) {
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			position += fPosition;
+			break;
+		case SEEK_END:
+			position += fSize;
+			break;
+		default:
+			return B_BAD_VALUE;
+	}
+
+	if (position < 0)
+		return B_BAD_VALUE;
+
+	fPosition = position;
+	return fPosition;
+}
+
+
+off_t
+FileRegionIO::Position() const
+{
+	return fPosition;
+}
+
+
+status_t
+FileRegionIO::SetSize(off_t size)
+{
+	return B_NOT_ALLOWED;
+}
+
+
+status_t
+FileRegionIO::GetSize(off_t* _size) const
+{
+	*_size = fSize;
+	return B_OK;
+}
+
+
+//	#pragma mark -
+
+
+container_type
+identify_container(const uint8* header, size_t size)
+{
+	if (size >= 4 && !memcmp(header, "fLaC", 4))
+		return kContainerFLAC;
+	if (size >= 4 && !memcmp(header, "OggS", 4))
+		return kContainerOgg;
+	if (size >= 8 && !memcmp(header + 4, "ftyp", 4))
+		return kContainerMP4;
+
+	return kContainerUnknown;
+}
+
+
+/*!	Finds the front cover, or if there is none, the first picture that
+	is embedded in the \a file. Only the blocks, atoms, or pages needed to
+	find it are read, never the audio data.
+*/
+status_t
+find_embedded_cover(BPositionIO& file, container_type type,
+	embedded_cover& cover)
+{
+	off_t fileSize;
+	status_t status = file.GetSize(&fileSize);
+	if (status != B_OK)
+		return status;
+
+	switch (type) {
+		case kContainerFLAC:
+			return find_flac_cover(file, fileSize, cover);
+		case kContainerMP4:
+			return find_mp4_cover(file, fileSize, cover);
+		case kContainerOgg:
+			return find_ogg_cover(file, cover);
+		default:
+			return B_NOT_SUPPORTED;
+	}
+}
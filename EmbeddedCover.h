@@ -0,0 +1,57 @@
+/* EmbeddedCover - finds the cover picture in FLAC, MP4, and Ogg files
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef EMBEDDED_COVER_H
+#define EMBEDDED_COVER_H
+
+
+#include <DataIO.h>
+
+
+enum container_type {
+	kContainerUnknown = 0,
+	kContainerFLAC,
+	kContainerMP4,
+	kContainerOgg
+};
+
+/*!	Where the picture is: either a region of the file, or, if it had to
+	be decoded first (as in Ogg comments), a malloc()ed buffer that has to
+	be freed by the caller.
+*/
+struct embedded_cover {
+	off_t	offset;
+	size_t	size;
+	uint8*	data;
+};
+
+
+/*!	Gives access to a region of another BPositionIO only, so that a
+	picture can be decoded right from the file it is embedded in.
+*/
+class FileRegionIO : public BPositionIO {
+	public:
+		FileRegionIO(BPositionIO* source, off_t offset, off_t size);
+
+		virtual ssize_t ReadAt(off_t position, void* buffer, size_t size);
+		virtual ssize_t WriteAt(off_t position, const void* buffer,
+							size_t size);
+		virtual off_t Seek(off_t position, uint32 seekMode);
+		virtual off_t Position() const;
+		virtual status_t SetSize(off_t size);
+		virtual status_t GetSize(off_t* _size) const;
+
+	private:
+		BPositionIO*	fSource;
+		off_t			fOffset;
+		off_t			fSize;
+		off_t			fPosition;
+};
+
+
+container_type identify_container(const uint8* header, size_t size);
+status_t find_embedded_cover(BPositionIO& file, container_type type,
+	embedded_cover& cover);
+
+#endif	// EMBEDDED_COVER_H
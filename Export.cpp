@@ -0,0 +1,172 @@
+/* Export - streams the computed album records while scanning
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Export.h"
+#include "Album.h"
+#include "JSON.h"
+
+#include <Autolock.h>
+#include <Locker.h>
+#include <Message.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct warning_name {
+	uint32		flag;
+	const char*	name;
+};
+
+static const warning_name kWarningNames[] = {
+	{kWarningDifferentArtists, "different artists"},
+	{kWarningDifferentAlbums, "different albums"},
+	{kWarningMissingLength, "missing length"},
+	{kWarningMissingYear, "missing year"},
+	{kWarningAmbiguousCover, "ambiguous cover"}
+};
+static const int32 kWarningCount
+	= sizeof(kWarningNames) / sizeof(kWarningNames[0]);
+
+static const char* kCoverSourceNames[] = {"none", "embedded", "image"};
+
+static FILE* sFile;
+static export_format sFormat;
+// volumes are scanned in parallel, but the records must not be mixed
+static BLocker sLock("export");
+
+
+static void
+export_json(const char* path, const album_attrs& attrs)
+{
+	fputs("{\"path\": ", sFile);
+	json_write_string(sFile, path);
+	fputs(", \"artist\": ", sFile);
+	json_write_string(sFile, attrs.artist);
+	fputs(", \"title\": ", sFile);
+	json_write_string(sFile, attrs.album);
+	fputs(", \"genre\": ", sFile);
+	json_write_string(sFile, attrs.genre);
+	fprintf(sFile, ", \"length\": %" B_PRId32 ", \"min_year\": %" B_PRId32
+		", \"max_year\": %" B_PRId32 ", "
+		"\"tracks\": %" B_PRId32 ", \"cover\": {\"source\": \"%s\", \"path\": ",
+		attrs.length, attrs.min_year, attrs.max_year, attrs.tracks,
+		kCoverSourceNames[attrs.cover_source]);
+	json_write_string(sFile, attrs.cover_path.String());
+	fputs("}, \"warnings\": [", sFile);
+
+	bool first = true;
+	for (int32 i = 0; i < kWarningCount; i++) {
+		if ((attrs.warnings & kWarningNames[i].flag) == 0)
+			continue;
+
+		if (!first)
+			fputs(", ", sFile);
+		json_write_string(sFile, kWarningNames[i].name);
+		first = false;
+	}
+
+	fputs("]}\n", sFile);
+}
+
+
+static void
+export_message(const char* path, const album_attrs& attrs)
+{
+	BMessage record(kMsgAlbumRecord);
+	record.AddString("path", path);
+	record.AddString("artist", attrs.artist);
+	record.AddString("title", attrs.album);
+	record.AddString("genre", attrs.genre);
+	record.AddInt32("length", attrs.length);
+	record.AddInt32("min year", attrs.min_year);
+	record.AddInt32("max year", attrs.max_year);
+	record.AddInt32("tracks", attrs.tracks);
+	record.AddString("cover source", kCoverSourceNames[attrs.cover_source]);
+	record.AddString("cover path", attrs.cover_path);
+
+	for (int32 i = 0; i < kWarningCount; i++) {
+		if ((attrs.warnings & kWarningNames[i].flag) != 0)
+			record.AddString("warning", kWarningNames[i].name);
+	}
+
+	ssize_t size = record.FlattenedSize();
+	char* buffer = (char*)malloc(size);
+	if (buffer == NULL)
+		return;
+
+	if (record.Flatten(buffer, size) == B_OK)
+		fwrite(buffer, 1, size, sFile);
+
+	free(buffer);
+}
+
+
+//	#pragma mark -
+
+
+/*!	Starts exporting album records to the file at \a path, or to standard
+	output if \a path is "-". Records are flushed one by one, so that other
+	tools can consume them while the scan is still running.
+*/
+status_t
+export_open(const char* path, export_format format)
+{
+	if (!strcmp(path, "-"))
+		sFile = stdout;
+	else {
+		sFile = fopen(path, format == kExportNDJSON ? "w" : "wb");
+		if (sFile == NULL)
+			return errno;
+	}
+
+	sFormat = format;
+	return B_OK;
+}
+
+
+void
+export_close()
+{
+	if (sFile != NULL && sFile != stdout)
+		fclose(sFile);
+	else if (sFile != NULL)
+		fflush(sFile);
+
+	sFile = NULL;
+}
+
+
+bool
+export_enabled()
+{
+	return sFile != NULL;
+}
+
+
+bool
+export_to_stdout()
+{
+	return sFile == stdout;
+}
+
+
+void
+export_album(const char* path, const album_attrs& attrs)
+{
+	if (sFile == NULL)
+		return;
+
+	BAutolock _(sLock);
+
+	if (sFormat == kExportMessage)
+		export_message(path, attrs);
+	else
+		export_json(path, attrs);
+
+	fflush(sFile);
+}
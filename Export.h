@@ -0,0 +1,29 @@
+/* Export - streams the computed album records while scanning
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef EXPORT_H
+#define EXPORT_H
+
+
+#include <SupportDefs.h>
+
+
+struct album_attrs;
+
+enum export_format {
+	kExportNDJSON = 0,	// one JSON object per line
+	kExportMessage		// a flattened BMessage per album
+};
+
+static const uint32 kMsgAlbumRecord = 'pAlb';
+
+
+status_t export_open(const char* path, export_format format);
+void export_close();
+bool export_enabled();
+bool export_to_stdout();
+
+void export_album(const char* path, const album_attrs& attrs);
+
+#endif	// EXPORT_H
@@ -0,0 +1,167 @@
+/* IconPyramid - scales a cover down to all icon sizes at once
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "IconPyramid.h"
+
+#include <Bitmap.h>
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+
+/*!	Scales the B_RGBA32 \a source to a square of \a size pixels, averaging
+	all source pixels that fall into a target pixel. When the source is
+	smaller than the target, pixels are just repeated.
+*/
+static void
+box_scale(const uint8* source, int32 width, int32 height, int32 bytesPerRow,
+	bool opaque, uint8* target, int32 size)
+{
+	for (int32 y = 0; y < size; y++) {
+		int32 top = y * height / size;
+		int32 bottom = std::max(top + 1, (y + 1) * height / size);
+
+		for (int32 x = 0; x < size; x++) {
+			int32 left = x * width / size;
+			int32 right = std::max(left + 1, (x + 1) * width / size);
+
+			uint32 sum[4] = {0, 0, 0, 0};
+			for (int32 sourceY = top; sourceY < bottom; sourceY++) {
+				const uint8* pixel = source + sourceY * bytesPerRow + left * 4;
+				for (int32 sourceX = left; sourceX < right; sourceX++) {
+					sum[0] += pixel[0];
+					sum[1] += pixel[1];
+					sum[2] += pixel[2];
+					sum[3] += pixel[3];
+					pixel += 4;
+				}
+			}
+
+			uint32 count = (bottom - top) * (right - left);
+			for (int32 i = 0; i < 3; i++)
+				*target++ = (sum[i] + count / 2) / count;
+			*target++ = opaque ? 255 : (sum[3] + count / 2) / count;
+		}
+	}
+}
+
+
+/*!	Halves the B_RGBA32 square \a source of \a size pixels. */
+static void
+halve(const uint8* source, int32 size, uint8* target)
+{
+	int32 bytesPerRow = size * 4;
+
+	for (int32 y = 0; y < size / 2; y++) {
+		const uint8* row = source + y * 2 * bytesPerRow;
+
+		for (int32 x = 0; x < size / 2; x++) {
+			for (int32 i = 0; i < 4; i++) {
+				*target++ = (row[i] + row[i + 4] + row[bytesPerRow + i]
+					+ row[bytesPerRow + i + 4] + 2) / 4;
+			}
+			row += 8;
+		}
+	}
+}
+
+
+static int32
+level_offset(int32 size)
+{
+	int32 offset = 0;
+	for (int32 i = 0; i < kIconPyramidLevels; i++) {
+		if (kIconPyramidSizes[i] == size)
+			return offset;
+
+		offset += kIconPyramidSizes[i] * kIconPyramidSizes[i] * 4;
+	}
+
+	return -1;
+}
+
+
+//	#pragma mark -
+
+
+IconPyramid::IconPyramid()
+	:
+	fBits(NULL)
+{
+}
+
+
+IconPyramid::~IconPyramid()
+{
+	free(fBits);
+}
+
+
+status_t
+IconPyramid::SetTo(const BBitmap* source)
+{
+	if (source == NULL || source->InitCheck() != B_OK)
+		return B_BAD_VALUE;
+
+	if (fBits == NULL) {
+		int32 size = 0;
+		for (int32 i = 0; i < kIconPyramidLevels; i++)
+			size += kIconPyramidSizes[i] * kIconPyramidSizes[i] * 4;
+
+		fBits = (uint8*)malloc(size);
+		if (fBits == NULL)
+			return B_NO_MEMORY;
+	}
+
+	// the cover is scanned in B_RGBA32, whatever it was decoded to
+
+	const BBitmap* bitmap = source;
+	BBitmap* converted = NULL;
+	bool opaque = source->ColorSpace() == B_RGB32;
+
+	if (source->ColorSpace() != B_RGB32 && source->ColorSpace() != B_RGBA32) {
+		converted = new BBitmap(source->Bounds(), B_RGBA32);
+		status_t status = converted->InitCheck();
+		if (status == B_OK)
+			status = converted->ImportBits(source);
+		if (status != B_OK) {
+			delete converted;
+			return status;
+		}
+
+		bitmap = converted;
+	}
+
+	BRect bounds = bitmap->Bounds();
+	box_scale((const uint8*)bitmap->Bits(), bounds.IntegerWidth() + 1,
+		bounds.IntegerHeight() + 1, bitmap->BytesPerRow(), opaque, fBits,
+		kIconPyramidSizes[0]);
+	delete converted;
+
+	uint8* level = fBits;
+	for (int32 i = 1; i < kIconPyramidLevels; i++) {
+		int32 size = kIconPyramidSizes[i - 1];
+		halve(level, size, level + size * size * 4);
+		level += size * size * 4;
+	}
+
+	return B_OK;
+}
+
+
+/*!	Returns the B_RGBA32 bits of the icon of \a size pixels, or NULL if
+	there is no such size.
+*/
+const uint8*
+IconPyramid::Bits(int32 size) const
+{
+	int32 offset = level_offset(size);
+	if (fBits == NULL || offset < 0)
+		return NULL;
+
+	return fBits + offset;
+}
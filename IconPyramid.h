@@ -0,0 +1,40 @@
+/* IconPyramid - scales a cover down to all icon sizes at once
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef ICON_PYRAMID_H
+#define ICON_PYRAMID_H
+
+
+#include <SupportDefs.h>
+
+
+class BBitmap;
+
+// the sizes of the legacy icons, from the largest to the smallest
+static const int32 kIconPyramidSizes[] = {32, 16};
+static const int32 kIconPyramidLevels
+	= sizeof(kIconPyramidSizes) / sizeof(kIconPyramidSizes[0]);
+
+
+/*!	Holds a cover in all icon sizes as B_RGBA32 bits. The largest size is
+	box filtered from the decoded cover, and every smaller one from the
+	size above it, so that the cover is only decoded and scanned once.
+	Like the legacy icons, the cover is stretched to a square.
+*/
+class IconPyramid {
+	public:
+		IconPyramid();
+		~IconPyramid();
+
+		status_t SetTo(const BBitmap* source);
+
+		const uint8* Bits(int32 size) const;
+		int32 BitsLength(int32 size) const { return size * size * 4; }
+		int32 BytesPerRow(int32 size) const { return size * 4; }
+
+	private:
+		uint8*	fBits;
+};
+
+#endif	// ICON_PYRAMID_H
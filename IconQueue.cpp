@@ -0,0 +1,156 @@
+/* IconQueue - creates the cover icons of albums in the background
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "IconQueue.h"
+#include "Stats.h"
+
+#include <Autolock.h>
+#include <OS.h>
+
+#include <stdlib.h>
+
+
+IconQueue::IconQueue(icon_hook hook, int32 workers, int32 capacity,
+	int32 priority)
+	:
+	fHook(hook),
+	fLock("icon queue"),
+	fJobSem(-1),
+	fSlotSem(-1),
+	fThreads(NULL),
+	fThreadCount(0)
+{
+	if (workers < 1)
+		workers = 1;
+	if (capacity < workers)
+		capacity = workers;
+
+	fJobSem = create_sem(0, "icon jobs");
+	fSlotSem = create_sem(capacity, "icon slots");
+	fThreads = (thread_id*)malloc(workers * sizeof(thread_id));
+	if (fJobSem < B_OK || fSlotSem < B_OK || fThreads == NULL)
+		return;
+
+	for (int32 i = 0; i < workers; i++) {
+		thread_id thread = spawn_thread(&_Thread, "albumattr icons", priority,
+			this);
+		if (thread < B_OK)
+			break;
+
+		fThreads[fThreadCount++] = thread;
+		resume_thread(thread);
+	}
+}
+
+
+IconQueue::~IconQueue()
+{
+	Finish();
+
+	if (fSlotSem >= B_OK)
+		delete_sem(fSlotSem);
+	free(fThreads);
+}
+
+
+status_t
+IconQueue::InitCheck() const
+{
+	if (fJobSem < B_OK)
+		return fJobSem;
+	if (fSlotSem < B_OK)
+		return fSlotSem;
+
+	return fThreadCount > 0 ? B_OK : B_NO_MEMORY;
+}
+
+
+void
+IconQueue::Add(const entry_ref& directory, cover_kind coverSource,
+	const char* coverPath)
+{
+	icon_job job;
+	job.directory = directory;
+	job.cover_source = coverSource;
+	job.cover_path = coverPath;
+
+	if (fThreadCount == 0 || fJobSem < B_OK) {
+		// there is no one to do it for us
+		fHook(job);
+		return;
+	}
+
+	// wait for a free slot if the workers cannot keep up
+	status_t status = acquire_sem_etc(fSlotSem, 1, B_RELATIVE_TIMEOUT, 0);
+	if (status == B_WOULD_BLOCK || status == B_TIMED_OUT) {
+		stats_count(kCounterIconQueueWaits);
+
+		do {
+			status = acquire_sem(fSlotSem);
+		} while (status == B_INTERRUPTED);
+	}
+	if (status != B_OK) {
+		fHook(job);
+		return;
+	}
+
+	BAutolock _(fLock);
+	fJobs.push_back(job);
+	release_sem(fJobSem);
+}
+
+
+/*!	Waits until all icons have been created, and stops the workers. */
+void
+IconQueue::Finish()
+{
+	if (fJobSem >= B_OK) {
+		// the workers go through the remaining jobs before they notice
+		delete_sem(fJobSem);
+		fJobSem = -1;
+	}
+
+	for (int32 i = 0; i < fThreadCount; i++) {
+		status_t status;
+		wait_for_thread(fThreads[i], &status);
+	}
+	fThreadCount = 0;
+}
+
+
+/*static*/ status_t
+IconQueue::_Thread(void* self)
+{
+	((IconQueue*)self)->_Work();
+	return B_OK;
+}
+
+
+void
+IconQueue::_Work()
+{
+	while (true) {
+		status_t status = acquire_sem(fJobSem);
+		if (status == B_INTERRUPTED)
+			continue;
+
+		icon_job job;
+		{
+			BAutolock _(fLock);
+			if (fJobs.empty()) {
+				if (status != B_OK)
+					return;
+				continue;
+			}
+
+			job = fJobs.front();
+			fJobs.pop_front();
+		}
+
+		release_sem(fSlotSem);
+		fHook(job);
+	}
+}
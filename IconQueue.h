@@ -0,0 +1,60 @@
+/* IconQueue - creates the cover icons of albums in the background
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef ICON_QUEUE_H
+#define ICON_QUEUE_H
+
+
+#include <Entry.h>
+#include <Locker.h>
+#include <String.h>
+
+#include <deque>
+
+#include "Album.h"
+
+
+struct icon_job {
+	entry_ref	directory;
+	cover_kind	cover_source;
+	BString		cover_path;
+};
+
+typedef void (*icon_hook)(const icon_job& job);
+
+
+/*!	A pool of worker threads that create the icons of the albums that have
+	been handed to it, while the scan itself goes on: decoding and scaling
+	the covers keeps the CPUs busy while the scan waits for the disk, and
+	the album attributes are there as soon as possible.
+	The queue holds at most "capacity" jobs; if the workers fall behind,
+	Add() blocks until there is room again, so that the scan does not run
+	arbitrarily far ahead of them.
+*/
+class IconQueue {
+	public:
+		IconQueue(icon_hook hook, int32 workers, int32 capacity,
+				int32 priority);
+		~IconQueue();
+
+		status_t InitCheck() const;
+
+		void Add(const entry_ref& directory, cover_kind coverSource,
+				const char* coverPath);
+		void Finish();
+
+	private:
+		static status_t _Thread(void* self);
+		void _Work();
+
+		icon_hook				fHook;
+		BLocker					fLock;
+		std::deque<icon_job>	fJobs;
+		sem_id					fJobSem;
+		sem_id					fSlotSem;
+		thread_id*				fThreads;
+		int32					fThreadCount;
+};
+
+#endif	// ICON_QUEUE_H
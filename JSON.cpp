@@ -0,0 +1,51 @@
+/* JSON - minimal helpers to write JSON output
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "JSON.h"
+
+
+/*!	Writes \a string as a quoted JSON string, escaping everything that
+	JSON does not allow literally. Bytes above 0x7f are passed through,
+	as file names and attributes are UTF-8 already.
+*/
+void
+json_write_string(FILE* file, const char* string)
+{
+	fputc('"', file);
+
+	if (string == NULL)
+		string = "";
+
+	for (; string[0]; string++) {
+		unsigned char c = string[0];
+
+		switch (c) {
+			case '"':
+				fputs("\\\"", file);
+				break;
+			case '\\':
+				fputs("\\\\", file);
+				break;
+			case '\n':
+				fputs("\\n", file);
+				break;
+			case '\r':
+				fputs("\\r", file);
+				break;
+			case '\t':
+				fputs("\\t", file);
+				break;
+			default:
+				if (c < 0x20)
+					fprintf(file, "\\u%04x", c);
+				else
+					fputc(c, file);
+				break;
+		}
+	}
+
+	fputc('"', file);
+}
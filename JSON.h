@@ -0,0 +1,14 @@
+/* JSON - minimal helpers to write JSON output
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef JSON_H
+#define JSON_H
+
+
+#include <stdio.h>
+
+
+void json_write_string(FILE* file, const char* string);
+
+#endif	// JSON_H
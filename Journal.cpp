@@ -0,0 +1,190 @@
+/* Journal - remembers completed directories to resume interrupted runs
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Journal.h"
+
+#include <Autolock.h>
+#include <FindDirectory.h>
+#include <Locker.h>
+#include <OS.h>
+#include <Path.h>
+#include <String.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+
+
+/*	The journal is a text file with one line per completed directory: a
+	single character for the result of handleDirectory() ('Y' for true,
+	'N' for false), a space, and the path of the directory.
+	Every line is appended with a single write(), and the file is synced
+	to disk from time to time; a line that was only partially written
+	when the run was interrupted is ignored when resuming.
+*/
+
+static const char* kJournalHeader = "albumattr journal 1\n";
+static const bigtime_t kSyncInterval = 1000000;
+
+typedef std::map<BString, bool> ResultMap;
+
+static int sFD = -1;
+static BString sPath;
+static ResultMap sCompleted;
+static bigtime_t sLastSync;
+static BLocker sLock("journal");
+
+
+static status_t
+load_journal(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return errno;
+
+	char line[B_PATH_NAME_LENGTH + 4];
+	if (fgets(line, sizeof(line), file) == NULL
+		|| strcmp(line, kJournalHeader)) {
+		fclose(file);
+		return B_BAD_DATA;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		size_t length = strlen(line);
+		if (length < 3 || line[length - 1] != '\n' || line[1] != ' '
+			|| (line[0] != 'Y' && line[0] != 'N'))
+			continue;
+
+		line[length - 1] = '\0';
+		sCompleted[line + 2] = line[0] == 'Y';
+	}
+
+	fclose(file);
+	return B_OK;
+}
+
+
+//	#pragma mark -
+
+
+status_t
+journal_default_path(char* buffer, size_t size)
+{
+	BPath path;
+	status_t status = find_directory(B_USER_SETTINGS_DIRECTORY, &path);
+	if (status != B_OK)
+		return status;
+
+	path.Append("pinc.albumattr journal");
+	strlcpy(buffer, path.Path(), size);
+	return B_OK;
+}
+
+
+/*!	Opens the journal at \a path. If \a resume is true, the directories
+	recorded in it are skipped by journal_lookup(), and new ones are
+	appended; otherwise the journal is started from scratch.
+*/
+status_t
+journal_open(const char* path, bool resume)
+{
+	bool append = false;
+
+	if (resume) {
+		status_t status = load_journal(path);
+		if (status == B_OK)
+			append = true;
+		else if (status != ENOENT) {
+			fprintf(stderr, "albumattr: ignoring journal \"%s\": %s\n", path,
+				strerror(status));
+		}
+	}
+
+	sFD = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC),
+		0644);
+	if (sFD < 0)
+		return errno;
+
+	if (!append && write(sFD, kJournalHeader, strlen(kJournalHeader)) < 0) {
+		status_t status = errno;
+		close(sFD);
+		sFD = -1;
+		return status;
+	}
+
+	sPath = path;
+	sLastSync = system_time();
+	return B_OK;
+}
+
+
+/*!	Closes the journal. If the run has \a completed, the journal is no
+	longer needed, and is removed.
+*/
+void
+journal_close(bool completed)
+{
+	if (sFD < 0)
+		return;
+
+	fsync(sFD);
+	close(sFD);
+	sFD = -1;
+
+	if (completed)
+		unlink(sPath.String());
+
+	sCompleted.clear();
+}
+
+
+bool
+journal_lookup(const char* path, bool& _result)
+{
+	BAutolock _(sLock);
+
+	if (sCompleted.empty())
+		return false;
+
+	ResultMap::const_iterator found = sCompleted.find(path);
+	if (found == sCompleted.end())
+		return false;
+
+	_result = found->second;
+	return true;
+}
+
+
+void
+journal_record(const char* path, bool result)
+{
+	BAutolock _(sLock);
+
+	if (sFD < 0)
+		return;
+
+	BString line;
+	line << (result ? "Y " : "N ") << path << "\n";
+
+	if (write(sFD, line.String(), line.Length()) < 0) {
+		fprintf(stderr, "albumattr: could not write journal: %s\n",
+			strerror(errno));
+		close(sFD);
+		sFD = -1;
+		return;
+	}
+
+	bigtime_t now = system_time();
+	if (now - sLastSync >= kSyncInterval) {
+		fsync(sFD);
+		sLastSync = now;
+	}
+}
@@ -0,0 +1,19 @@
+/* Journal - remembers completed directories to resume interrupted runs
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+
+#include <SupportDefs.h>
+
+
+status_t journal_default_path(char* buffer, size_t size);
+status_t journal_open(const char* path, bool resume);
+void journal_close(bool completed);
+
+bool journal_lookup(const char* path, bool& _result);
+void journal_record(const char* path, bool result);
+
+#endif	// JOURNAL_H
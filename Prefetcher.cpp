@@ -0,0 +1,332 @@
+/* Prefetcher - reads the files of a directory ahead of their parsing
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Prefetcher.h"
+#include "Album.h"
+#include "Stats.h"
+#include "TailTags.h"
+#include "Throttle.h"
+
+#include <Entry.h>
+#include <File.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+
+// the part of the file that is always read
+static const size_t kHeadSize = 65536;
+// ID3v2 tags are read completely up to this size
+static const size_t kMaxHeadSize = 4 * 1024 * 1024;
+
+
+/*!	Returns the complete size of the ID3v2 tag that starts with \a header,
+	including its header and footer, or 0 if there is none.
+*/
+size_t
+id3v2_tag_size(const uint8* header, size_t size)
+{
+	if (size < 10 || memcmp(header, "ID3", 3) || header[3] == 0xff
+		|| header[4] == 0xff || ((header[6] | header[7] | header[8]
+			| header[9]) & 0x80) != 0)
+		return 0;
+
+	size_t tagSize = ((size_t)header[6] << 21) | ((size_t)header[7] << 14)
+		| ((size_t)header[8] << 7) | header[9];
+
+	// the footer flag only exists in ID3v2.4
+	if (header[3] >= 4 && (header[5] & 0x10) != 0)
+		tagSize += 10;
+
+	return tagSize + 10;
+}
+
+
+//	#pragma mark -
+
+
+Prefetcher::Prefetcher(int32 depth, file_type_hook hook)
+	:
+	fDepth(depth),
+	fHook(hook),
+	fBuffers(NULL),
+	fFreeSem(-1),
+	fReadySem(-1),
+	fThread(-1),
+	fNames(NULL),
+	fCount(0),
+	fNext(0),
+	fQuit(false)
+{
+	fBuffers = (prefetch_buffer*)calloc(depth, sizeof(prefetch_buffer));
+	if (fBuffers == NULL)
+		return;
+
+	for (int32 i = 0; i < depth; i++) {
+		fBuffers[i].tail = (uint8*)malloc(kTailTagsWindow);
+		if (fBuffers[i].tail == NULL) {
+			fDepth = i;
+			break;
+		}
+	}
+}
+
+
+Prefetcher::~Prefetcher()
+{
+	Finish();
+
+	if (fBuffers != NULL) {
+		for (int32 i = 0; i < fDepth; i++) {
+			free(fBuffers[i].head);
+			free(fBuffers[i].tail);
+		}
+		free(fBuffers);
+	}
+}
+
+
+status_t
+Prefetcher::InitCheck() const
+{
+	return fBuffers != NULL && fDepth > 0 ? B_OK : B_NO_MEMORY;
+}
+
+
+/*!	Starts reading the entries \a names of \a directory in the given
+	order. The names must stay valid until Finish() is called.
+*/
+status_t
+Prefetcher::Start(const BPath& directory, const char* const* names,
+	int32 count)
+{
+	Finish();
+
+	fDirectory = directory;
+	fNames = names;
+	fCount = count;
+	fNext = 0;
+	fQuit = false;
+
+	fFreeSem = create_sem(fDepth, "prefetch free");
+	fReadySem = create_sem(0, "prefetch ready");
+	if (fFreeSem < B_OK || fReadySem < B_OK) {
+		Finish();
+		return B_NO_MORE_SEMS;
+	}
+
+	fThread = spawn_thread(&_ReaderThread, "albumattr prefetch",
+		throttle_background() ? B_LOW_PRIORITY : B_NORMAL_PRIORITY, this);
+	if (fThread < B_OK) {
+		status_t status = fThread;
+		Finish();
+		return status;
+	}
+
+	resume_thread(fThread);
+	return B_OK;
+}
+
+
+/*!	Returns the buffer of the next entry, as soon as it has been read, or
+	NULL if all entries have been handed out.
+*/
+const prefetch_buffer*
+Prefetcher::Next()
+{
+	if (fNext >= fCount)
+		return NULL;
+
+	status_t status;
+	do {
+		status = acquire_sem(fReadySem);
+	} while (status == B_INTERRUPTED);
+
+	if (status != B_OK)
+		return NULL;
+
+	return &fBuffers[fNext % fDepth];
+}
+
+
+void
+Prefetcher::Recycle()
+{
+	fNext++;
+	release_sem(fFreeSem);
+}
+
+
+/*!	Stops the reader thread, and waits for it; entries that have not been
+	handed out yet are skipped.
+*/
+void
+Prefetcher::Finish()
+{
+	fQuit = true;
+
+	if (fFreeSem >= B_OK)
+		delete_sem(fFreeSem);
+	if (fReadySem >= B_OK)
+		delete_sem(fReadySem);
+
+	if (fThread >= B_OK) {
+		status_t status;
+		wait_for_thread(fThread, &status);
+	}
+
+	fFreeSem = -1;
+	fReadySem = -1;
+	fThread = -1;
+}
+
+
+/*static*/ status_t
+Prefetcher::_ReaderThread(void* self)
+{
+	((Prefetcher*)self)->_Read();
+	return B_OK;
+}
+
+
+void
+Prefetcher::_Read()
+{
+	for (int32 i = 0; i < fCount && !fQuit; i++) {
+		status_t status;
+		do {
+			status = acquire_sem(fFreeSem);
+		} while (status == B_INTERRUPTED);
+
+		if (status != B_OK || fQuit)
+			return;
+
+		_Fill(fBuffers[i % fDepth], fNames[i]);
+		release_sem(fReadySem);
+	}
+}
+
+
+void
+Prefetcher::_Fill(prefetch_buffer& buffer, const char* name)
+{
+	buffer.head_size = 0;
+	buffer.tail_size = 0;
+	buffer.file_size = 0;
+	buffer.file_type = -1;
+	buffer.is_directory = false;
+	buffer.status = B_OK;
+
+	BPath path(fDirectory.Path(), name);
+	BEntry entry(path.Path(), false);
+
+	buffer.is_directory = entry.IsDirectory();
+	if (buffer.is_directory)
+		return;
+
+	buffer.file_type = fHook(entry);
+	if (buffer.file_type != kAudioFile)
+		return;
+
+	throttle_open_file();
+
+	BFile file(&entry, B_READ_ONLY);
+	buffer.status = file.InitCheck();
+	if (buffer.status == B_OK)
+		buffer.status = file.GetSize(&buffer.file_size);
+	if (buffer.status == B_OK)
+		buffer.status = _ReadHead(file, buffer);
+	if (buffer.status != B_OK)
+		return;
+
+	if (id3v2_tag_size(buffer.head, buffer.head_size) == 0
+		&& buffer.file_size > (off_t)buffer.head_size) {
+		// there might be tags at the end of the file instead
+		bigtime_t start = system_time();
+		ssize_t bytesRead = _ReadTail(file, buffer);
+		if (bytesRead > 0) {
+			stats_count(kCounterBytesPrefetched, bytesRead);
+			throttle_read(bytesRead, system_time() - start);
+		}
+	}
+}
+
+
+/*!	Reads the end of the file, which always ends with the file, even if it
+	overlaps the head. Only its last kTailTagsProbeSize bytes are read at
+	first, and more only if the tags found there reach further.
+	Returns the number of bytes read.
+*/
+ssize_t
+Prefetcher::_ReadTail(BFile& file, prefetch_buffer& buffer)
+{
+	size_t limit = std::min(buffer.file_size, (off_t)kTailTagsWindow);
+	size_t size = std::min(limit, kTailTagsProbeSize);
+
+	ssize_t bytesRead = file.ReadAt(buffer.file_size - size, buffer.tail,
+		size);
+	if (bytesRead != (ssize_t)size)
+		return bytesRead;
+
+	size_t extent;
+	while ((extent = std::min(tail_tags_extent(buffer.tail, size), limit))
+			> size) {
+		// move what we have to the end, and read what is in front of it
+		memmove(buffer.tail + extent - size, buffer.tail, size);
+		ssize_t result = file.ReadAt(buffer.file_size - extent, buffer.tail,
+			extent - size);
+		if (result != (ssize_t)(extent - size))
+			return bytesRead;
+
+		bytesRead += result;
+		size = extent;
+	}
+
+	buffer.tail_size = size;
+	return bytesRead;
+}
+
+
+status_t
+Prefetcher::_ReadHead(BFile& file, prefetch_buffer& buffer)
+{
+	size_t size = kHeadSize;
+
+	while (true) {
+		if ((off_t)size > buffer.file_size)
+			size = buffer.file_size;
+
+		if (size > buffer.head_capacity) {
+			uint8* head = (uint8*)realloc(buffer.head, size);
+			if (head == NULL)
+				return B_NO_MEMORY;
+
+			buffer.head = head;
+			buffer.head_capacity = size;
+		}
+
+		bigtime_t start = system_time();
+		ssize_t bytesRead = file.ReadAt(buffer.head_size,
+			buffer.head + buffer.head_size, size - buffer.head_size);
+		if (bytesRead < 0)
+			return bytesRead;
+
+		buffer.head_size += bytesRead;
+		stats_count(kCounterBytesPrefetched, bytesRead);
+		throttle_read(bytesRead, system_time() - start);
+
+		// read the whole ID3v2 tag, if it is not too large
+		size_t tagSize = id3v2_tag_size(buffer.head, buffer.head_size);
+		if (tagSize <= buffer.head_size || tagSize > kMaxHeadSize
+			|| buffer.head_size < size || (off_t)buffer.head_size
+				>= buffer.file_size)
+			return B_OK;
+
+		size = tagSize;
+	}
+}
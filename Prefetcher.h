@@ -0,0 +1,80 @@
+/* Prefetcher - reads the files of a directory ahead of their parsing
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+
+#include <OS.h>
+#include <Path.h>
+
+
+class BEntry;
+class BFile;
+
+struct prefetch_buffer {
+	uint8*		head;
+	size_t		head_size;
+	size_t		head_capacity;
+	uint8*		tail;		// the end of the file, if it has no ID3v2 tag
+	size_t		tail_size;
+	off_t		file_size;
+	int32		file_type;
+	bool		is_directory;
+	status_t	status;
+};
+
+typedef int32 (*file_type_hook)(BEntry& entry);
+
+
+/*!	A reader thread that walks a list of entries ahead of the caller, and
+	fills a ring of pooled buffers with what the parser will need from
+	them: whether the entry is a directory, its file type, and for audio
+	files, the head (up to the whole ID3v2 tag) and, if there is no such
+	tag, as much of the end of the file as the tags there need, but at
+	most kTailTagsWindow bytes (unless the head already contains all of
+	it).
+	The buffers are handed out in list order by Next(), and must be given
+	back with Recycle() before the next one can be requested; at most
+	"depth" buffers are filled ahead.
+*/
+class Prefetcher {
+	public:
+		Prefetcher(int32 depth, file_type_hook hook);
+		~Prefetcher();
+
+		status_t InitCheck() const;
+		int32 Depth() const { return fDepth; }
+
+		status_t Start(const BPath& directory, const char* const* names,
+					int32 count);
+		const prefetch_buffer* Next();
+		void Recycle();
+		void Finish();
+
+	private:
+		static status_t _ReaderThread(void* self);
+		void _Read();
+		void _Fill(prefetch_buffer& buffer, const char* name);
+		status_t _ReadHead(BFile& file, prefetch_buffer& buffer);
+		ssize_t _ReadTail(BFile& file, prefetch_buffer& buffer);
+
+		int32				fDepth;
+		file_type_hook		fHook;
+		prefetch_buffer*	fBuffers;
+		sem_id				fFreeSem;
+		sem_id				fReadySem;
+		thread_id			fThread;
+
+		BPath				fDirectory;
+		const char* const*	fNames;
+		int32				fCount;
+		int32				fNext;
+		volatile bool		fQuit;
+};
+
+
+size_t id3v2_tag_size(const uint8* header, size_t size);
+
+#endif	// PREFETCHER_H
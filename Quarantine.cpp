@@ -0,0 +1,160 @@
+/* Quarantine - remembers files that made a decoder hang or crash
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Quarantine.h"
+
+#include <Autolock.h>
+#include <FindDirectory.h>
+#include <Locker.h>
+#include <Path.h>
+#include <String.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <set>
+
+
+/*	The quarantine is a text file like the journal: a header, and one line
+	per file, with a single character for the reason ('T' for a timeout,
+	'C' for a crash), a space, and the path of the file. Unlike the
+	journal, it is kept across runs; remove a line (or the whole file) to
+	give a file another chance.
+*/
+
+static const char* kQuarantineHeader = "albumattr quarantine 1\n";
+
+typedef std::set<BString> PathSet;
+
+static int sFD = -1;
+static PathSet sPaths;
+static BLocker sLock("quarantine");
+
+
+static status_t
+load_quarantine(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return errno;
+
+	char line[B_PATH_NAME_LENGTH + 4];
+	if (fgets(line, sizeof(line), file) == NULL
+		|| strcmp(line, kQuarantineHeader)) {
+		fclose(file);
+		return B_BAD_DATA;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		size_t length = strlen(line);
+		if (length < 3 || line[length - 1] != '\n' || line[1] != ' ')
+			continue;
+
+		line[length - 1] = '\0';
+		sPaths.insert(line + 2);
+	}
+
+	fclose(file);
+	return B_OK;
+}
+
+
+//	#pragma mark -
+
+
+status_t
+quarantine_default_path(char* buffer, size_t size)
+{
+	BPath path;
+	status_t status = find_directory(B_USER_SETTINGS_DIRECTORY, &path);
+	if (status != B_OK)
+		return status;
+
+	path.Append("pinc.albumattr quarantine");
+	strlcpy(buffer, path.Path(), size);
+	return B_OK;
+}
+
+
+/*!	Loads the quarantine at \a path, if there is one, and opens it to
+	add more files to it.
+*/
+status_t
+quarantine_open(const char* path)
+{
+	status_t status = load_quarantine(path);
+	bool append = status == B_OK;
+	if (status != B_OK && status != ENOENT) {
+		fprintf(stderr, "albumattr: ignoring quarantine \"%s\": %s\n", path,
+			strerror(status));
+	}
+
+	sFD = open(path, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC),
+		0644);
+	if (sFD < 0)
+		return errno;
+
+	if (!append && write(sFD, kQuarantineHeader,
+			strlen(kQuarantineHeader)) < 0) {
+		status = errno;
+		close(sFD);
+		sFD = -1;
+		return status;
+	}
+
+	return B_OK;
+}
+
+
+void
+quarantine_close()
+{
+	if (sFD >= 0) {
+		close(sFD);
+		sFD = -1;
+	}
+
+	sPaths.clear();
+}
+
+
+bool
+quarantine_contains(const char* path)
+{
+	BAutolock _(sLock);
+	return sPaths.find(path) != sPaths.end();
+}
+
+
+void
+quarantine_add(const char* path, quarantine_reason reason)
+{
+	BAutolock _(sLock);
+
+	if (!sPaths.insert(path).second)
+		return;
+
+	fprintf(stderr, "albumattr: \"%s\" %s, skipping it from now on\n", path,
+		reason == kQuarantineTimeout ? "timed out" : "crashed the decoder");
+
+	if (sFD < 0)
+		return;
+
+	BString line;
+	line += (char)reason;
+	line << " " << path << "\n";
+
+	if (write(sFD, line.String(), line.Length()) < 0
+		|| fsync(sFD) != 0) {
+		fprintf(stderr, "albumattr: could not write quarantine: %s\n",
+			strerror(errno));
+		close(sFD);
+		sFD = -1;
+	}
+}
@@ -0,0 +1,25 @@
+/* Quarantine - remembers files that made a decoder hang or crash
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef QUARANTINE_H
+#define QUARANTINE_H
+
+
+#include <SupportDefs.h>
+
+
+enum quarantine_reason {
+	kQuarantineTimeout = 'T',
+	kQuarantineCrash = 'C'
+};
+
+
+status_t quarantine_default_path(char* buffer, size_t size);
+status_t quarantine_open(const char* path);
+void quarantine_close();
+
+bool quarantine_contains(const char* path);
+void quarantine_add(const char* path, quarantine_reason reason);
+
+#endif	// QUARANTINE_H
@@ -0,0 +1,338 @@
+/* Stats - per-phase timing and counters for albumattr
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Stats.h"
+#include "JSON.h"
+
+#include <Autolock.h>
+#include <Locker.h>
+#include <String.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+
+static const int32 kSlowestCount = 10;
+
+struct phase_stats {
+	bigtime_t	time;
+	int64		calls;
+};
+
+struct slow_directory {
+	BString		path;
+	bigtime_t	time;
+};
+
+static const char* kPhaseNames[kPhaseCount] = {
+	"read directory",
+	"file type",
+	"attributes",
+	"tags",
+	"media kit",
+	"collect images",
+	"cover decode",
+	"create icons",
+	"write attributes",
+	"throttled"
+};
+
+static const char* kCounterNames[kCounterCount] = {
+	"directories",
+	"albums",
+	"files",
+	"audio files",
+	"image files",
+	"embedded covers",
+	"media kit opens",
+	"icons written",
+	"attributes written",
+	"bytes prefetched",
+	"arena blocks",
+	"throttle waits",
+	"decoder timeouts",
+	"quarantined files",
+	"decoders skipped",
+	"known non-albums",
+	"icon queue waits",
+	"unsampled tracks",
+	"sample escalations"
+};
+
+stats_format gStats = kStatsNone;
+
+// The phase and counter totals are shared by all threads, and updated
+// atomically; the timers that are currently running are per thread.
+static phase_stats sPhases[kPhaseCount];
+static int64 sCounters[kCounterCount];
+static __thread PhaseTimer* sCurrentTimer;
+static __thread scan_phase sCurrentPhase;
+static __thread bigtime_t sCurrentStart;
+static __thread DirectoryTimer* sCurrentDirectory;
+static bigtime_t sStartTime;
+static BLocker sLock("stats");
+
+static bigtime_t* sAlbumTimes;
+static int32 sAlbumCount;
+static int32 sAlbumCapacity;
+
+static slow_directory sSlowest[kSlowestCount];
+static int32 sSlowestCount;
+
+
+static void
+charge_current(bigtime_t now)
+{
+	if (sCurrentTimer == NULL)
+		return;
+
+	atomic_add64(&sPhases[sCurrentPhase].time, now - sCurrentStart);
+}
+
+
+static void
+add_album_time(bigtime_t time)
+{
+	if (sAlbumCount == sAlbumCapacity) {
+		int32 capacity = sAlbumCapacity > 0 ? sAlbumCapacity * 2 : 256;
+		bigtime_t* times = (bigtime_t*)realloc(sAlbumTimes,
+			capacity * sizeof(bigtime_t));
+		if (times == NULL)
+			return;
+
+		sAlbumTimes = times;
+		sAlbumCapacity = capacity;
+	}
+
+	sAlbumTimes[sAlbumCount++] = time;
+}
+
+
+static void
+add_directory_time(const char* path, bigtime_t time)
+{
+	if (sSlowestCount == kSlowestCount
+		&& sSlowest[kSlowestCount - 1].time >= time)
+		return;
+
+	// keep the list sorted, slowest first
+
+	int32 index = sSlowestCount < kSlowestCount
+		? sSlowestCount++ : kSlowestCount - 1;
+	while (index > 0 && sSlowest[index - 1].time < time) {
+		sSlowest[index] = sSlowest[index - 1];
+		index--;
+	}
+
+	sSlowest[index].path = path;
+	sSlowest[index].time = time;
+}
+
+
+static int
+compare_times(const void* _a, const void* _b)
+{
+	bigtime_t a = *(const bigtime_t*)_a;
+	bigtime_t b = *(const bigtime_t*)_b;
+
+	return a < b ? -1 : a > b ? 1 : 0;
+}
+
+
+static bigtime_t
+percentile(int32 percent)
+{
+	if (sAlbumCount == 0)
+		return 0;
+
+	int32 index = (int32)(((int64)sAlbumCount * percent + 99) / 100) - 1;
+	if (index < 0)
+		index = 0;
+
+	return sAlbumTimes[index];
+}
+
+
+static void
+print_table(FILE* file, bigtime_t total)
+{
+	bigtime_t phaseTotal = 0;
+	for (int32 i = 0; i < kPhaseCount; i++)
+		phaseTotal += sPhases[i].time;
+
+	fprintf(file, "\n%-20s %12s %10s %7s\n", "phase", "time (ms)", "calls",
+		"share");
+
+	for (int32 i = 0; i < kPhaseCount; i++) {
+		fprintf(file, "%-20s %12.1f %10lld %6.1f%%\n", kPhaseNames[i],
+			sPhases[i].time / 1000.0, (long long)sPhases[i].calls,
+			phaseTotal > 0 ? 100.0 * sPhases[i].time / phaseTotal : 0.0);
+	}
+
+	fprintf(file, "%-20s %12.1f\n\n", "total (wall clock)", total / 1000.0);
+
+	for (int32 i = 0; i < kCounterCount; i++) {
+		fprintf(file, "%-20s %12lld\n", kCounterNames[i],
+			(long long)sCounters[i]);
+	}
+
+	fprintf(file, "\nalbum latency: p50 %.1f ms, p99 %.1f ms (%" B_PRId32 " albums)\n",
+		percentile(50) / 1000.0, percentile(99) / 1000.0, sAlbumCount);
+
+	if (sSlowestCount > 0)
+		fprintf(file, "\nslowest directories:\n");
+
+	for (int32 i = 0; i < sSlowestCount; i++) {
+		fprintf(file, "%12.1f ms  %s\n", sSlowest[i].time / 1000.0,
+			sSlowest[i].path.String());
+	}
+}
+
+
+static void
+print_json(FILE* file, bigtime_t total)
+{
+	fprintf(file, "{\"total_us\": %lld, \"phases\": {", (long long)total);
+
+	for (int32 i = 0; i < kPhaseCount; i++) {
+		fprintf(file, "%s", i > 0 ? ", " : "");
+		json_write_string(file, kPhaseNames[i]);
+		fprintf(file, ": {\"time_us\": %lld, \"calls\": %lld}",
+			(long long)sPhases[i].time, (long long)sPhases[i].calls);
+	}
+
+	fprintf(file, "}, \"counters\": {");
+
+	for (int32 i = 0; i < kCounterCount; i++) {
+		fprintf(file, "%s", i > 0 ? ", " : "");
+		json_write_string(file, kCounterNames[i]);
+		fprintf(file, ": %lld", (long long)sCounters[i]);
+	}
+
+	fprintf(file, "}, \"album_latency_us\": {\"count\": %" B_PRId32 ", \"p50\": %lld, "
+		"\"p99\": %lld}, \"slowest\": [", sAlbumCount,
+		(long long)percentile(50), (long long)percentile(99));
+
+	for (int32 i = 0; i < sSlowestCount; i++) {
+		fprintf(file, "%s{\"path\": ", i > 0 ? ", " : "");
+		json_write_string(file, sSlowest[i].path.String());
+		fprintf(file, ", \"time_us\": %lld}", (long long)sSlowest[i].time);
+	}
+
+	fprintf(file, "]}\n");
+}
+
+
+//	#pragma mark -
+
+
+PhaseTimer::PhaseTimer(scan_phase phase)
+	:
+	fPhase(phase),
+	fPrevious(NULL),
+	fStart(0)
+{
+	if (gStats == kStatsNone)
+		return;
+
+	fStart = system_time();
+	charge_current(fStart);
+
+	fPrevious = sCurrentTimer;
+	sCurrentTimer = this;
+	sCurrentPhase = fPhase;
+	sCurrentStart = fStart;
+	atomic_add64(&sPhases[fPhase].calls, 1);
+}
+
+
+PhaseTimer::~PhaseTimer()
+{
+	if (fStart == 0)
+		return;
+
+	bigtime_t now = system_time();
+	charge_current(now);
+
+	sCurrentTimer = fPrevious;
+	if (fPrevious != NULL)
+		sCurrentPhase = fPrevious->fPhase;
+	sCurrentStart = now;
+}
+
+
+DirectoryTimer::DirectoryTimer(const char* path)
+	:
+	fPath(path),
+	fParent(NULL),
+	fStart(0),
+	fChildTime(0),
+	fIsAlbum(false)
+{
+	if (gStats == kStatsNone)
+		return;
+
+	fStart = system_time();
+	atomic_test_and_set64(&sStartTime, fStart, 0);
+
+	fParent = sCurrentDirectory;
+	sCurrentDirectory = this;
+}
+
+
+DirectoryTimer::~DirectoryTimer()
+{
+	if (fStart == 0)
+		return;
+
+	bigtime_t elapsed = system_time() - fStart;
+	if (fParent != NULL)
+		fParent->fChildTime += elapsed;
+	sCurrentDirectory = fParent;
+
+	elapsed -= fChildTime;
+
+	stats_count(kCounterDirectories);
+	if (fIsAlbum)
+		stats_count(kCounterAlbums);
+
+	BAutolock locker(sLock);
+
+	if (fIsAlbum)
+		add_album_time(elapsed);
+
+	add_directory_time(fPath, elapsed);
+}
+
+
+//	#pragma mark -
+
+
+void
+stats_count(scan_counter counter, int64 amount)
+{
+	if (gStats != kStatsNone)
+		atomic_add64(&sCounters[counter], amount);
+}
+
+
+void
+stats_print(FILE* file)
+{
+	if (gStats == kStatsNone)
+		return;
+
+	BAutolock locker(sLock);
+
+	bigtime_t total = sStartTime != 0 ? system_time() - sStartTime : 0;
+
+	qsort(sAlbumTimes, sAlbumCount, sizeof(bigtime_t), &compare_times);
+
+	if (gStats == kStatsJSON)
+		print_json(file, total);
+	else
+		print_table(file, total);
+}
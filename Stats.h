@@ -0,0 +1,101 @@
+/* Stats - per-phase timing and counters for albumattr
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+
+#include <OS.h>
+
+#include <stdio.h>
+
+
+enum scan_phase {
+	kPhaseReadDirectory = 0,
+	kPhaseFileType,
+	kPhaseAttributes,
+	kPhaseTags,
+	kPhaseMediaKit,
+	kPhaseCollectImages,
+	kPhaseCoverDecode,
+	kPhaseCreateIcons,
+	kPhaseWriteAttributes,
+	kPhaseThrottle,
+
+	kPhaseCount
+};
+
+enum scan_counter {
+	kCounterDirectories = 0,
+	kCounterAlbums,
+	kCounterFiles,
+	kCounterAudioFiles,
+	kCounterImageFiles,
+	kCounterEmbeddedCovers,
+	kCounterMediaKitOpens,
+	kCounterIconsWritten,
+	kCounterAttributesWritten,
+	kCounterBytesPrefetched,
+	kCounterArenaBlocks,
+	kCounterThrottleWaits,
+	kCounterDecoderTimeouts,
+	kCounterQuarantineSkips,
+	kCounterDecoderSkips,
+	kCounterRejectedSkips,
+	kCounterIconQueueWaits,
+	kCounterUnsampledTracks,
+	kCounterSampleEscalations,
+
+	kCounterCount
+};
+
+enum stats_format {
+	kStatsNone = 0,
+	kStatsTable,
+	kStatsJSON
+};
+
+extern stats_format gStats;
+
+
+/*!	Charges the time between its construction and destruction to a phase.
+	Timers nest: while an inner timer runs, the outer one is paused, so
+	the phase times add up to the time spent in all phases together.
+	Timers of different threads are independent, so with more than one
+	thread, the phase times may add up to more than the wall clock time.
+*/
+class PhaseTimer {
+	public:
+		PhaseTimer(scan_phase phase);
+		~PhaseTimer();
+
+	private:
+		scan_phase	fPhase;
+		PhaseTimer*	fPrevious;
+		bigtime_t	fStart;
+};
+
+/*!	Measures the time spent in a single directory, excluding the time
+	spent in its sub-directories.
+*/
+class DirectoryTimer {
+	public:
+		DirectoryTimer(const char* path);
+		~DirectoryTimer();
+
+		void SetAlbum(bool album) { fIsAlbum = album; }
+
+	private:
+		const char*		fPath;
+		DirectoryTimer*	fParent;
+		bigtime_t		fStart;
+		bigtime_t		fChildTime;
+		bool			fIsAlbum;
+};
+
+
+void stats_count(scan_counter counter, int64 amount = 1);
+void stats_print(FILE* file);
+
+#endif	// STATS_H
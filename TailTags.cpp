@@ -0,0 +1,415 @@
+/* TailTags - reads the ID3v1, Lyrics3, and APEv2 tags at the end of a file
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "TailTags.h"
+#include "Album.h"
+#include "Arena.h"
+
+#include <DataIO.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+
+static const size_t kID3v1Size = 128;
+static const size_t kAPEFooterSize = 32;
+static const size_t kLyrics3v1MaxSize = 5100;
+
+static const char* kID3v1Genres[] = {
+	"Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge",
+	"Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B",
+	"Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska",
+	"Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient",
+	"Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical",
+	"Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+	"AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative",
+	"Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+	"Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+	"Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap",
+	"Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave",
+	"Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+	"Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll",
+	"Hard Rock", "Folk", "Folk-Rock", "National Folk", "Swing", "Fast Fusion",
+	"Bebob", "Latin", "Revival", "Celtic", "Bluegrass", "Avantgarde",
+	"Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock",
+	"Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic", "Humour",
+	"Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony",
+	"Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam", "Club",
+	"Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul",
+	"Freestyle", "Duet", "Punk Rock", "Drum Solo", "A capella", "Euro-House",
+	"Dance Hall", "Goa", "Drum & Bass", "Club-House", "Hardcore", "Terror",
+	"Indie", "BritPop", "Negerpunk", "Polsk Punk", "Beat",
+	"Christian Gangsta Rap", "Heavy Metal", "Black Metal", "Crossover",
+	"Contemporary Christian", "Christian Rock", "Merengue", "Salsa",
+	"Thrash Metal", "Anime", "JPop", "Synthpop"
+};
+static const size_t kID3v1GenreCount
+	= sizeof(kID3v1Genres) / sizeof(kID3v1Genres[0]);
+
+
+static inline uint32
+read_le32(const uint8* data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16)
+		| ((uint32)data[3] << 24);
+}
+
+
+static size_t
+parse_decimal(const uint8* data, size_t length)
+{
+	size_t value = 0;
+	for (size_t i = 0; i < length; i++) {
+		if (data[i] < '0' || data[i] > '9')
+			return 0;
+
+		value = value * 10 + data[i] - '0';
+	}
+
+	return value;
+}
+
+
+static int32
+parse_year(const uint8* data, size_t length)
+{
+	int32 year = 0;
+	for (size_t i = 0; i < length && i < 4; i++) {
+		if (data[i] < '0' || data[i] > '9')
+			break;
+
+		year = year * 10 + data[i] - '0';
+	}
+
+	return year >= 1000 ? year : 0;
+}
+
+
+/*!	Interns a UTF-8 string right from the tag; padding is removed. */
+static const char*
+intern_utf8(Arena& arena, const uint8* string, size_t length)
+{
+	const uint8* end = (const uint8*)memchr(string, '\0', length);
+	if (end != NULL)
+		length = end - string;
+	while (length > 0 && string[length - 1] == ' ')
+		length--;
+
+	return length > 0 ? arena.Intern((const char*)string, length) : NULL;
+}
+
+
+/*!	Interns a Latin-1 string; it is only converted to UTF-8 on the stack if
+	it actually contains non-ASCII characters.
+*/
+static const char*
+intern_latin1(Arena& arena, const uint8* string, size_t length)
+{
+	const uint8* end = (const uint8*)memchr(string, '\0', length);
+	if (end != NULL)
+		length = end - string;
+	while (length > 0 && string[length - 1] == ' ')
+		length--;
+
+	bool ascii = true;
+	for (size_t i = 0; i < length && ascii; i++)
+		ascii = string[i] < 0x80;
+
+	if (ascii || length > 256)
+		return length > 0 ? arena.Intern((const char*)string, length) : NULL;
+
+	char buffer[512];
+	size_t size = 0;
+	for (size_t i = 0; i < length; i++) {
+		if (string[i] < 0x80)
+			buffer[size++] = string[i];
+		else {
+			buffer[size++] = 0xc0 | (string[i] >> 6);
+			buffer[size++] = 0x80 | (string[i] & 0x3f);
+		}
+	}
+
+	return arena.Intern(buffer, size);
+}
+
+
+static inline bool
+is_empty(const char* string)
+{
+	return string == NULL || string[0] == '\0';
+}
+
+
+static void
+set_string(const char*& field, const char* string)
+{
+	if (is_empty(field) && string != NULL)
+		field = string;
+}
+
+
+/*!	Parses the items of an APEv2 tag; their values are UTF-8. */
+static void
+parse_ape(const uint8* items, size_t size, uint32 count, Arena& arena,
+	audio_attrs& attrs)
+{
+	size_t offset = 0;
+
+	for (uint32 i = 0; i < count && offset + 9 <= size; i++) {
+		uint32 valueSize = read_le32(items + offset);
+		uint32 flags = read_le32(items + offset + 4);
+		offset += 8;
+
+		const uint8* key = items + offset;
+		const uint8* keyEnd = (const uint8*)memchr(key, '\0', size - offset);
+		if (keyEnd == NULL)
+			return;
+
+		offset = keyEnd + 1 - items;
+		if (valueSize > size - offset)
+			return;
+
+		const uint8* value = items + offset;
+		offset += valueSize;
+
+		// only text items are of interest
+		if ((flags & 0x6) != 0)
+			continue;
+
+		if (!strcasecmp((const char*)key, "Artist"))
+			set_string(attrs.artist, intern_utf8(arena, value, valueSize));
+		else if (!strcasecmp((const char*)key, "Album"))
+			set_string(attrs.album, intern_utf8(arena, value, valueSize));
+		else if (!strcasecmp((const char*)key, "Genre"))
+			set_string(attrs.genre, intern_utf8(arena, value, valueSize));
+		else if (!strcasecmp((const char*)key, "Year") && attrs.year == 0)
+			attrs.year = parse_year(value, valueSize);
+	}
+}
+
+
+/*!	Parses the fields of a Lyrics3 v2 tag; the extended artist and album
+	fields are not limited to 30 characters as in ID3v1.
+*/
+static void
+parse_lyrics3(const uint8* fields, size_t size, Arena& arena,
+	audio_attrs& attrs)
+{
+	size_t offset = 0;
+
+	while (offset + 8 <= size) {
+		const uint8* id = fields + offset;
+		size_t length = parse_decimal(fields + offset + 3, 5);
+		offset += 8;
+		if (length > size - offset)
+			return;
+
+		if (!memcmp(id, "EAR", 3))
+			set_string(attrs.artist, intern_latin1(arena, fields + offset, length));
+		else if (!memcmp(id, "EAL", 3))
+			set_string(attrs.album, intern_latin1(arena, fields + offset, length));
+
+		offset += length;
+	}
+}
+
+
+static void
+parse_id3v1(const uint8* tag, Arena& arena, audio_attrs& attrs)
+{
+	// ID3v1.1 keeps the track number in the last bytes of the comment,
+	// which does not touch the fields used here
+	set_string(attrs.artist, intern_latin1(arena, tag + 33, 30));
+	set_string(attrs.album, intern_latin1(arena, tag + 63, 30));
+
+	if (attrs.year == 0)
+		attrs.year = parse_year(tag + 93, 4);
+
+	uint8 genre = tag[127];
+	if (genre < kID3v1GenreCount)
+		set_string(attrs.genre, arena.Intern(kID3v1Genres[genre]));
+}
+
+
+//	#pragma mark -
+
+
+/*!	Returns whether any of the attributes that the tags at the end of a
+	file could provide is still missing.
+*/
+bool
+tail_tags_needed(const audio_attrs& attrs)
+{
+	return is_empty(attrs.artist) || is_empty(attrs.album)
+		|| is_empty(attrs.genre) || attrs.year == 0;
+}
+
+
+/*!	Returns how much of the end of a file has to be read to get all of
+	its tags, as far as the last \a size bytes of the file in \a tail can
+	tell. If this is more than \a size, the end of the file has to be read
+	again with the returned size, as there might be even more in front of
+	what has been found so far. Never returns more than kTailTagsWindow.
+*/
+size_t
+tail_tags_extent(const uint8* tail, size_t size)
+{
+	size_t end = size;
+
+	if (end < kID3v1Size || memcmp(tail + end - kID3v1Size, "TAG", 3)) {
+		// without an ID3v1 tag, there can only be an APEv2 tag
+		if (end >= kAPEFooterSize
+			&& !memcmp(tail + end - kAPEFooterSize, "APETAGEX", 8)) {
+			return std::min((size_t)read_le32(tail + end - kAPEFooterSize + 12),
+				kTailTagsWindow);
+		}
+		return 0;
+	}
+
+	end -= kID3v1Size;
+
+	if (end >= 15 && !memcmp(tail + end - 9, "LYRICS200", 9)) {
+		size_t tagSize = parse_decimal(tail + end - 15, 6);
+		if (tagSize + 15 > end) {
+			// an APEv2 tag might still be in front of it
+			return std::min(size + tagSize + 15 - end + kAPEFooterSize,
+				kTailTagsWindow);
+		}
+		end -= tagSize + 15;
+	} else if (end >= 9 && !memcmp(tail + end - 9, "LYRICSEND", 9)) {
+		// Lyrics3 v1 has no size
+		return kTailTagsWindow;
+	}
+
+	if (end < kAPEFooterSize) {
+		// there is a Lyrics3 tag, but we cannot see in front of it yet
+		return end == size - kID3v1Size ? kID3v1Size
+			: std::min(size - end + kAPEFooterSize, kTailTagsWindow);
+	}
+
+	if (!memcmp(tail + end - kAPEFooterSize, "APETAGEX", 8)) {
+		size_t tagSize = read_le32(tail + end - kAPEFooterSize + 12);
+		return std::min(size - end + tagSize, kTailTagsWindow);
+	}
+
+	return size - end;
+}
+
+
+/*!	Parses the tags in the last \a size bytes of a file in place, and fills
+	in those fields of \a attrs that are still empty. The tags are expected
+	in their usual order: an APEv2 tag, a Lyrics3 tag, and an ID3v1 tag at
+	the very end; any of them may be missing. When tags disagree, APEv2 is
+	preferred over Lyrics3, which is preferred over ID3v1.
+	Returns whether any tag has been found.
+*/
+bool
+parse_tail_tags(const uint8* tail, size_t size, Arena& arena,
+	audio_attrs& attrs)
+{
+	size_t end = size;
+
+	const uint8* id3v1 = NULL;
+	if (end >= kID3v1Size && !memcmp(tail + end - kID3v1Size, "TAG", 3)) {
+		id3v1 = tail + end - kID3v1Size;
+		end -= kID3v1Size;
+	}
+
+	const uint8* lyrics = NULL;
+	size_t lyricsSize = 0;
+	if (id3v1 != NULL && end >= 15 && !memcmp(tail + end - 9, "LYRICS200", 9)) {
+		// the size covers everything from "LYRICSBEGIN" up to itself
+		size_t tagSize = parse_decimal(tail + end - 15, 6);
+		if (tagSize >= 11 && tagSize + 15 <= end
+			&& !memcmp(tail + end - 15 - tagSize, "LYRICSBEGIN", 11)) {
+			lyrics = tail + end - 15 - tagSize + 11;
+			lyricsSize = tagSize - 11;
+			end -= tagSize + 15;
+		}
+	} else if (id3v1 != NULL && end >= 9
+		&& !memcmp(tail + end - 9, "LYRICSEND", 9)) {
+		// Lyrics3 v1 has no size, and only contains the lyrics
+		size_t limit = end > kLyrics3v1MaxSize + 20
+			? end - kLyrics3v1MaxSize - 20 : 0;
+		for (size_t offset = end - 9; offset-- > limit;) {
+			if (!memcmp(tail + offset, "LYRICSBEGIN", 11)) {
+				end = offset;
+				break;
+			}
+		}
+	}
+
+	bool found = id3v1 != NULL;
+
+	if (end >= kAPEFooterSize
+		&& !memcmp(tail + end - kAPEFooterSize, "APETAGEX", 8)) {
+		const uint8* footer = tail + end - kAPEFooterSize;
+		uint32 tagSize = read_le32(footer + 12);
+		uint32 count = read_le32(footer + 16);
+		if (tagSize >= kAPEFooterSize && tagSize <= end) {
+			parse_ape(tail + end - tagSize, tagSize - kAPEFooterSize, count,
+				arena, attrs);
+			found = true;
+		}
+	}
+
+	if (lyrics != NULL)
+		parse_lyrics3(lyrics, lyricsSize, arena, attrs);
+	if (id3v1 != NULL)
+		parse_id3v1(id3v1, arena, attrs);
+
+	return found;
+}
+
+
+/*!	Reads the end of the \a file, and parses the tags in it. Only the last
+	kTailTagsProbeSize bytes are read at first; more is only read if they
+	end with a Lyrics3 or APEv2 tag that reaches further, and that part is
+	then allocated from the \a arena.
+	Returns the number of bytes read, or an error code.
+*/
+ssize_t
+read_tail_tags(BPositionIO& file, Arena& arena, audio_attrs& attrs)
+{
+	off_t fileSize;
+	status_t status = file.GetSize(&fileSize);
+	if (status != B_OK)
+		return status;
+	if (fileSize == 0)
+		return 0;
+
+	uint8 probe[kTailTagsProbeSize];
+	const uint8* tail = probe;
+	size_t size = std::min(fileSize, (off_t)kTailTagsProbeSize);
+	size_t limit = std::min(fileSize, (off_t)kTailTagsWindow);
+
+	ssize_t bytesRead = file.ReadAt(fileSize - size, probe, size);
+	if (bytesRead != (ssize_t)size)
+		return bytesRead;
+
+	size_t extent;
+	while ((extent = std::min(tail_tags_extent(tail, size), limit)) > size) {
+		// only the part in front of what we have is read
+		uint8* wider = (uint8*)arena.Allocate(extent);
+		if (wider == NULL)
+			return B_NO_MEMORY;
+
+		ssize_t result = file.ReadAt(fileSize - extent, wider, extent - size);
+		if (result != (ssize_t)(extent - size))
+			return result < 0 ? result : bytesRead;
+
+		memcpy(wider + extent - size, tail, size);
+		bytesRead += result;
+		tail = wider;
+		size = extent;
+	}
+
+	parse_tail_tags(tail, size, arena, attrs);
+	return bytesRead;
+}
@@ -0,0 +1,29 @@
+/* TailTags - reads the ID3v1, Lyrics3, and APEv2 tags at the end of a file
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef TAIL_TAGS_H
+#define TAIL_TAGS_H
+
+
+#include <SupportDefs.h>
+
+
+class Arena;
+class BPositionIO;
+struct audio_attrs;
+
+// the end of the file that is read first: an ID3v1 tag, and the end of
+// a Lyrics3 or APEv2 tag in front of it
+static const size_t kTailTagsProbeSize = 160;
+// the most of the end of the file that is read to find the tags
+static const size_t kTailTagsWindow = 65536;
+
+
+bool tail_tags_needed(const audio_attrs& attrs);
+size_t tail_tags_extent(const uint8* tail, size_t size);
+bool parse_tail_tags(const uint8* tail, size_t size, Arena& arena,
+	audio_attrs& attrs);
+ssize_t read_tail_tags(BPositionIO& file, Arena& arena, audio_attrs& attrs);
+
+#endif	// TAIL_TAGS_H
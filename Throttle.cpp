@@ -0,0 +1,267 @@
+/* Throttle - limits the I/O of albumattr for shared volumes
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Throttle.h"
+#include "Stats.h"
+
+#include <Autolock.h>
+#include <Locker.h>
+
+#include <algorithm>
+
+
+// how often the rate may be changed in response to the read latency
+static const bigtime_t kAdjustInterval = 1000000;
+// reads that take this much longer than usual make us back off
+static const int32 kLatencyFactor = 3;
+// smaller reads mostly measure the file cache, not the disk
+static const size_t kMinSampleSize = 16384;
+// the latencies are normalized to a read of this size
+static const size_t kSampleSize = 65536;
+// the usual latency is never assumed to be lower than this, so that a
+// run of cached reads cannot make every read from the disk look slow
+static const bigtime_t kMinBaseLatency = 500;
+// the rate is scaled in steps of 1/kScaleSteps of the configured one,
+// one step is regained per interval, and it never drops below one step
+static const int32 kScaleSteps = 16;
+
+struct token_bucket {
+	int64		rate;
+	double		tokens;
+	bigtime_t	last;
+};
+
+static bool sEnabled;
+static bool sBackground;
+static token_bucket sBytes;
+static token_bucket sFiles;
+
+// adjusted according to the read latency
+static int32 sScale = kScaleSteps;
+static bigtime_t sAverageLatency;
+static bigtime_t sBaseLatency;
+static bigtime_t sLastAdjust;
+static BLocker sLock("throttle");
+
+
+static void
+bucket_init(token_bucket& bucket, int64 rate)
+{
+	bucket.rate = rate;
+	// allow a burst of up to a second
+	bucket.tokens = rate;
+	bucket.last = system_time();
+}
+
+
+/*!	Takes \a amount tokens from the bucket, and returns how long the
+	caller has to wait until they would have been there. The tokens may
+	go negative, so that concurrent callers queue up behind each other.
+*/
+static bigtime_t
+bucket_take(token_bucket& bucket, int64 amount)
+{
+	if (bucket.rate <= 0)
+		return 0;
+
+	double rate = (double)bucket.rate * sScale / kScaleSteps;
+	bigtime_t now = system_time();
+
+	bucket.tokens += rate * (now - bucket.last) / 1000000.0;
+	if (bucket.tokens > rate)
+		bucket.tokens = rate;
+	bucket.last = now;
+
+	bucket.tokens -= amount;
+	if (bucket.tokens >= 0)
+		return 0;
+
+	return (bigtime_t)(-bucket.tokens * 1000000.0 / rate);
+}
+
+
+static void
+throttle_wait(bigtime_t delay)
+{
+	if (delay <= 0)
+		return;
+
+	PhaseTimer timer(kPhaseThrottle);
+	stats_count(kCounterThrottleWaits);
+	snooze(delay);
+}
+
+
+/*!	Adjusts the rate scale to the latency of the last read: when the
+	reads become much slower than they were when the volume was quiet,
+	someone else is using it, and the rate is halved; otherwise, it slowly
+	grows back to the configured rate.
+*/
+static void
+adjust_scale(bigtime_t latency)
+{
+	if (sAverageLatency == 0)
+		sAverageLatency = latency;
+	else
+		sAverageLatency = (sAverageLatency * 7 + latency) / 8;
+
+	if (sBaseLatency == 0 || sAverageLatency < sBaseLatency)
+		sBaseLatency = std::max(sAverageLatency, kMinBaseLatency);
+
+	bigtime_t now = system_time();
+	if (now - sLastAdjust < kAdjustInterval)
+		return;
+
+	sLastAdjust = now;
+
+	if (sAverageLatency > sBaseLatency) {
+		// Let the base follow slowly, in case the volume just got slower;
+		// much slower while we are backing off, or else a steady load by
+		// someone else would become the new base within a minute. It takes
+		// about three minutes to double then, so that we cannot get stuck
+		// at the lowest rate for the rest of the run either.
+		sBaseLatency += sBaseLatency / (sScale < kScaleSteps ? 256 : 64) + 1;
+	}
+
+	if (sAverageLatency > sBaseLatency * kLatencyFactor) {
+		if (sScale > 1)
+			sScale /= 2;
+	} else if (sScale < kScaleSteps)
+		sScale++;
+}
+
+
+//	#pragma mark -
+
+
+/*!	Sets up the limits for the run: \a bytesPerSecond and \a filesPerSecond
+	are the maximum rates, zero means no limit. In \a background mode, the
+	calling thread is given a low priority, which Haiku's I/O scheduler
+	also applies to its requests.
+*/
+status_t
+throttle_init(int64 bytesPerSecond, int32 filesPerSecond, bool background)
+{
+	bucket_init(sBytes, bytesPerSecond);
+	bucket_init(sFiles, filesPerSecond);
+
+	sEnabled = bytesPerSecond > 0 || filesPerSecond > 0;
+	sBackground = background;
+
+	if (background)
+		return set_thread_priority(find_thread(NULL), B_LOW_PRIORITY);
+
+	return B_OK;
+}
+
+
+bool
+throttle_enabled()
+{
+	return sEnabled;
+}
+
+
+bool
+throttle_background()
+{
+	return sBackground;
+}
+
+
+/*!	Must be called before a file is opened to read from it. */
+void
+throttle_open_file()
+{
+	if (!sEnabled)
+		return;
+
+	bigtime_t delay;
+	{
+		BAutolock _(sLock);
+		delay = bucket_take(sFiles, 1);
+	}
+
+	throttle_wait(delay);
+}
+
+
+/*!	Accounts for a read of \a bytes that took \a latency, and adapts the
+	rate to it. A \a latency of zero means that it is not known, for
+	example because the read is still to be done by someone else, like
+	the Media Kit. Reads of less than 16 KB are only counted against the
+	limit, as they are mostly served from the file cache.
+*/
+void
+throttle_read(size_t bytes, bigtime_t latency)
+{
+	if (!sEnabled)
+		return;
+
+	bigtime_t delay;
+	{
+		BAutolock _(sLock);
+		if (latency > 0 && bytes >= kMinSampleSize) {
+			// normalize to the time a 64 KB read would take
+			if (bytes > kSampleSize)
+				latency = latency * kSampleSize / bytes;
+			adjust_scale(latency);
+		}
+		delay = bucket_take(sBytes, bytes);
+	}
+
+	throttle_wait(delay);
+}
+
+
+//	#pragma mark -
+
+
+ThrottledIO::ThrottledIO(BPositionIO* source)
+	:
+	fSource(source)
+{
+}
+
+
+ssize_t
+ThrottledIO::ReadAt(off_t position, void* buffer, size_t size)
+{
+	bigtime_t start = system_time();
+	ssize_t bytesRead = fSource->ReadAt(position, buffer, size);
+	if (bytesRead > 0)
+		throttle_read(bytesRead, system_time() - start);
+
+	return bytesRead;
+}
+
+
+ssize_t
+ThrottledIO::WriteAt(off_t position, const void* buffer, size_t size)
+{
+	return B_NOT_ALLOWED;
+}
+
+
+off_t
+ThrottledIO::Seek(off_t position, uint32 seekMode)
+{
+	return fSource->Seek(position, seekMode);
+}
+
+
+off_t
+ThrottledIO::Position() const
+{
+	return fSource->Position();
+}
+
+
+status_t
+ThrottledIO::GetSize(off_t* _size) const
+{
+	return fSource->GetSize(_size);
+}
@@ -0,0 +1,40 @@
+/* Throttle - limits the I/O of albumattr for shared volumes
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+
+#include <DataIO.h>
+#include <OS.h>
+
+
+/*!	Passes all reads on to another BPositionIO, and accounts for them with
+	throttle_read(); it cannot be written to.
+*/
+class ThrottledIO : public BPositionIO {
+	public:
+		ThrottledIO(BPositionIO* source);
+
+		virtual ssize_t ReadAt(off_t position, void* buffer, size_t size);
+		virtual ssize_t WriteAt(off_t position, const void* buffer,
+					size_t size);
+		virtual off_t Seek(off_t position, uint32 seekMode);
+		virtual off_t Position() const;
+		virtual status_t GetSize(off_t* _size) const;
+
+	private:
+		BPositionIO*	fSource;
+};
+
+
+status_t throttle_init(int64 bytesPerSecond, int32 filesPerSecond,
+	bool background);
+bool throttle_enabled();
+bool throttle_background();
+
+void throttle_open_file();
+void throttle_read(size_t bytes, bigtime_t latency);
+
+#endif	// THROTTLE_H
@@ -0,0 +1,114 @@
+/* VolumeQueue - scans the directories of different volumes in parallel
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "VolumeQueue.h"
+
+#include <OS.h>
+
+#include <stdio.h>
+
+
+VolumeQueue::VolumeQueue(int32 jobsPerVolume, root_hook hook)
+	:
+	fJobsPerVolume(jobsPerVolume > 0 ? jobsPerVolume : 1),
+	fHook(hook)
+{
+}
+
+
+VolumeQueue::~VolumeQueue()
+{
+	for (size_t i = 0; i < fVolumes.size(); i++)
+		delete fVolumes[i];
+}
+
+
+void
+VolumeQueue::Add(const entry_ref& ref)
+{
+	for (size_t i = 0; i < fVolumes.size(); i++) {
+		if (fVolumes[i]->device == ref.device) {
+			fVolumes[i]->roots.push_back(ref);
+			return;
+		}
+	}
+
+	volume* newVolume = new volume;
+	newVolume->device = ref.device;
+	newVolume->roots.push_back(ref);
+	newVolume->next = 0;
+	newVolume->hook = fHook;
+	fVolumes.push_back(newVolume);
+}
+
+
+/*!	Handles all directories, and returns when they are done. With just a
+	single worker, they are handled in the calling thread.
+*/
+void
+VolumeQueue::Run()
+{
+	std::vector<thread_id> threads;
+	std::vector<volume*> workers;
+
+	for (size_t i = 0; i < fVolumes.size(); i++) {
+		int32 count = fVolumes[i]->roots.size();
+		if (count > fJobsPerVolume)
+			count = fJobsPerVolume;
+
+		for (int32 j = 0; j < count; j++)
+			workers.push_back(fVolumes[i]);
+	}
+
+	if (workers.size() == 1) {
+		_Worker(workers[0]);
+		return;
+	}
+
+	// the workers run at our priority, which is low in background mode
+	thread_info info;
+	int32 priority = B_NORMAL_PRIORITY;
+	if (get_thread_info(find_thread(NULL), &info) == B_OK)
+		priority = info.priority;
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		char name[B_OS_NAME_LENGTH];
+		snprintf(name, sizeof(name), "albumattr volume %" B_PRId32,
+			(int32)workers[i]->device);
+
+		thread_id thread = spawn_thread(&_Worker, name, priority, workers[i]);
+		if (thread < B_OK) {
+			// do its work ourselves then
+			_Worker(workers[i]);
+			continue;
+		}
+
+		resume_thread(thread);
+		threads.push_back(thread);
+	}
+
+	for (size_t i = 0; i < threads.size(); i++) {
+		status_t status;
+		wait_for_thread(threads[i], &status);
+	}
+}
+
+
+/*static*/ status_t
+VolumeQueue::_Worker(void* data)
+{
+	volume* queue = (volume*)data;
+
+	while (true) {
+		int32 index = atomic_add(&queue->next, 1);
+		if (index >= (int32)queue->roots.size())
+			break;
+
+		queue->hook(queue->roots[index]);
+	}
+
+	return B_OK;
+}
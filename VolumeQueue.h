@@ -0,0 +1,46 @@
+/* VolumeQueue - scans the directories of different volumes in parallel
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef VOLUME_QUEUE_H
+#define VOLUME_QUEUE_H
+
+
+#include <Entry.h>
+
+#include <vector>
+
+
+typedef void (*root_hook)(const entry_ref& ref);
+
+
+/*!	Groups the directories it is given by the volume they are on. Every
+	volume gets its own workers that work through its directories one
+	after the other, while the volumes are scanned at the same time, so
+	that all disks are busy, but none of them has to seek between more
+	directories than it has workers.
+*/
+class VolumeQueue {
+	public:
+		VolumeQueue(int32 jobsPerVolume, root_hook hook);
+		~VolumeQueue();
+
+		void Add(const entry_ref& ref);
+		void Run();
+
+	private:
+		struct volume {
+			dev_t					device;
+			std::vector<entry_ref>	roots;
+			int32					next;
+			root_hook				hook;
+		};
+
+		static status_t _Worker(void* data);
+
+		std::vector<volume*>	fVolumes;
+		int32					fJobsPerVolume;
+		root_hook				fHook;
+};
+
+#endif	// VOLUME_QUEUE_H
@@ -0,0 +1,277 @@
+/* Watchdog - runs untrusted decoders under a time limit
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+
+
+#include "Watchdog.h"
+
+#include <Autolock.h>
+#include <Locker.h>
+#include <image.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vector>
+
+
+// when this many jobs are still stuck, no more jobs are started
+static const int32 kMaxHungJobs = 4;
+
+static int32 sHungJobs;
+// the threads of all jobs given up on, whether they are done by now or not
+static std::vector<thread_id> sAbandonedThreads;
+static BLocker sAbandonedLock("watchdog abandoned");
+
+
+WatchdogJob::WatchdogJob()
+	:
+	fReferences(1),
+	fDoneSem(-1),
+	fAbandoned(0)
+{
+}
+
+
+WatchdogJob::~WatchdogJob()
+{
+	if (fDoneSem >= B_OK)
+		delete_sem(fDoneSem);
+}
+
+
+void
+WatchdogJob::Acquire()
+{
+	atomic_add(&fReferences, 1);
+}
+
+
+void
+WatchdogJob::Release()
+{
+	if (atomic_add(&fReferences, -1) == 1)
+		delete this;
+}
+
+
+/*static*/ status_t
+WatchdogJob::_Thread(void* self)
+{
+	WatchdogJob* job = (WatchdogJob*)self;
+	job->Run();
+
+	if (atomic_or(&job->fAbandoned, 2) & 1) {
+		// the caller has given up on us already
+		atomic_add(&sHungJobs, -1);
+	} else
+		release_sem(job->fDoneSem);
+
+	job->Release();
+	return B_OK;
+}
+
+
+//	#pragma mark -
+
+
+/*!	Runs \a job in a thread of its own, and waits at most \a timeout for
+	it; a \a timeout of zero runs it directly. Returns B_TIMED_OUT if the
+	job did not finish in time; it is then left running in the background.
+	If too many jobs are stuck like this already, B_BUSY is returned
+	without running the job at all.
+*/
+status_t
+watchdog_run(WatchdogJob* job, bigtime_t timeout)
+{
+	if (timeout <= 0) {
+		job->Run();
+		return B_OK;
+	}
+
+	if (atomic_get(&sHungJobs) >= kMaxHungJobs)
+		return B_BUSY;
+
+	job->fDoneSem = create_sem(0, "watchdog done");
+	if (job->fDoneSem < B_OK)
+		return job->fDoneSem;
+
+	thread_info info;
+	int32 priority = B_NORMAL_PRIORITY;
+	if (get_thread_info(find_thread(NULL), &info) == B_OK)
+		priority = info.priority;
+
+	job->Acquire();
+
+	thread_id thread = spawn_thread(&WatchdogJob::_Thread, "albumattr decoder",
+		priority, job);
+	if (thread < B_OK) {
+		job->Release();
+		return thread;
+	}
+
+	resume_thread(thread);
+
+	status_t status;
+	do {
+		status = acquire_sem_etc(job->fDoneSem, 1, B_RELATIVE_TIMEOUT, timeout);
+	} while (status == B_INTERRUPTED);
+
+	if (status == B_OK) {
+		wait_for_thread(thread, &status);
+		return B_OK;
+	}
+
+	if (atomic_or(&job->fAbandoned, 1) & 2) {
+		// it finished just now, after all
+		wait_for_thread(thread, &status);
+		return B_OK;
+	}
+
+	atomic_add(&sHungJobs, 1);
+
+	BAutolock _(sAbandonedLock);
+	sAbandonedThreads.push_back(thread);
+	return B_TIMED_OUT;
+}
+
+
+/*!	Waits until the threads of all jobs that watchdog_run() gave up on
+	are gone. They run the code of the image the job comes from, so the
+	Tracker add-on must call this before it returns, and is unloaded.
+*/
+void
+watchdog_wait_for_abandoned()
+{
+	BAutolock _(sAbandonedLock);
+
+	for (size_t i = 0; i < sAbandonedThreads.size(); i++) {
+		status_t status;
+		while (wait_for_thread(sAbandonedThreads[i], &status) == B_INTERRUPTED)
+			;
+	}
+
+	sAbandonedThreads.clear();
+}
+
+
+/*!	Finds the image this code is part of: the application, or the
+	Tracker add-on.
+*/
+status_t
+own_image(image_info& info)
+{
+	int32 cookie = 0;
+	while (get_next_image_info(0, &cookie, &info) == B_OK) {
+		if ((addr_t)&own_image >= (addr_t)info.text
+			&& (addr_t)&own_image < (addr_t)info.text + info.text_size)
+			return B_OK;
+	}
+
+	return B_ENTRY_NOT_FOUND;
+}
+
+
+/*!	Starts a copy of the running executable (the application, or the
+	Tracker add-on) with the hidden "--probe=<kind>" option on \a path,
+	and collects what it writes to the pipe it is given in \a output.
+	Returns B_TIMED_OUT if it did not exit within \a timeout (zero waits
+	forever), and kills it, or kSandboxCrashed if it was killed by a
+	signal. If it could not be started, or could not do its work on the
+	file, another error is returned; the file is not to blame then.
+	The helper is started with load_image() rather than fork(), as the
+	Tracker team we might run in has lots of threads.
+*/
+status_t
+sandbox_run(const char* kind, const char* path, bigtime_t timeout,
+	BMallocIO& output)
+{
+	image_info info;
+	status_t status = own_image(info);
+	if (status != B_OK)
+		return status;
+
+	int pipes[2];
+	if (pipe(pipes) != 0)
+		return errno;
+
+	// only the write end is inherited; the helper closes anything else
+	// it got from us, including the pipes of other helpers
+	fcntl(pipes[0], F_SETFD, FD_CLOEXEC);
+
+	char option[64];
+	snprintf(option, sizeof(option), "--probe=%s", kind);
+	char outputOption[64];
+	snprintf(outputOption, sizeof(outputOption), "--probe-output=%d",
+		pipes[1]);
+
+	const char* args[] = {info.name, option, outputOption, path, NULL};
+	thread_id child = load_image(4, args, (const char**)environ);
+	close(pipes[1]);
+
+	if (child < B_OK) {
+		close(pipes[0]);
+		return child;
+	}
+
+	resume_thread(child);
+
+	bigtime_t deadline = system_time() + timeout;
+	bool timedOut = false;
+	output.SetSize(0);
+
+	while (true) {
+		// without a timeout, we wait for as long as it takes
+		int pollTimeout = -1;
+		if (timeout > 0) {
+			bigtime_t left = deadline - system_time();
+			if (left <= 0) {
+				timedOut = true;
+				break;
+			}
+			pollTimeout = (int)(left / 1000) + 1;
+		}
+
+		struct pollfd pollFD = {pipes[0], POLLIN, 0};
+		int result = poll(&pollFD, 1, pollTimeout);
+		if (result < 0 && errno == EINTR)
+			continue;
+		if (result <= 0) {
+			timedOut = result == 0;
+			break;
+		}
+
+		char buffer[4096];
+		ssize_t bytesRead = read(pipes[0], buffer, sizeof(buffer));
+		if (bytesRead <= 0)
+			break;
+
+		output.Write(buffer, bytesRead);
+	}
+
+	close(pipes[0]);
+
+	if (timedOut)
+		kill(child, SIGKILL);
+
+	int childStatus;
+	while (waitpid(child, &childStatus, 0) < 0 && errno == EINTR)
+		;
+
+	if (timedOut)
+		return B_TIMED_OUT;
+	if (WIFSIGNALED(childStatus))
+		return kSandboxCrashed;
+	if (!WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0)
+		return B_ERROR;
+
+	return B_OK;
+}
@@ -0,0 +1,49 @@
+/* Watchdog - runs untrusted decoders under a time limit
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+
+#include <DataIO.h>
+#include <OS.h>
+#include <image.h>
+
+
+/*!	A call into a decoder or translator that might never return. The job
+	is reference counted: if it takes too long, the caller gives up on it,
+	and the thread that runs it drops the last reference whenever it is
+	done, so everything the job works on must be owned by the job itself.
+*/
+class WatchdogJob {
+	public:
+		WatchdogJob();
+		virtual ~WatchdogJob();
+
+		virtual void Run() = 0;
+
+		void Acquire();
+		void Release();
+
+	private:
+		friend status_t watchdog_run(WatchdogJob* job, bigtime_t timeout);
+		static status_t _Thread(void* self);
+
+		int32		fReferences;
+		sem_id		fDoneSem;
+		int32		fAbandoned;
+};
+
+
+status_t watchdog_run(WatchdogJob* job, bigtime_t timeout);
+void watchdog_wait_for_abandoned();
+
+// sandbox_run() result when the helper process crashed on the file
+const status_t kSandboxCrashed = B_ERRORS_END + 1;
+
+status_t own_image(image_info& info);
+status_t sandbox_run(const char* kind, const char* path, bigtime_t timeout,
+	BMallocIO& output);
+
+#endif	// WATCHDOG_H
@@ -5,6 +5,7 @@
 
 
 #include <Application.h>
+#include <Autolock.h>
 #include <CheckBox.h>
 #include <Alert.h>
 #include <String.h>
@@ -24,17 +25,43 @@
 #include <kernel/fs_info.h>
 #include <kernel/fs_attr.h>
 
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
 
 #include <taglib/attachedpictureframe.h>
 #include <taglib/id3v2frame.h>
 #include <taglib/id3v2header.h>
 #include <taglib/id3v2tag.h>
 #include <taglib/mpegfile.h>
+#include <taglib/tbytevectorstream.h>
+#include <taglib/tfilestream.h>
 
+#include "Album.h"
+#include "AlbumAggregator.h"
 #include "AlbumIcon.h"
+#include "Arena.h"
+#include "Catalogue.h"
+#include "EmbeddedCover.h"
+#include "Export.h"
+#include "IconPyramid.h"
+#include "IconQueue.h"
+#include "Journal.h"
+#include "Prefetcher.h"
+#include "Quarantine.h"
+#include "Stats.h"
+#include "TailTags.h"
+#include "Throttle.h"
+#include "VolumeQueue.h"
+#include "Watchdog.h"
 
 static const char *kAlbumMimeString = "application/x-vnd.Be-directory-album";
 static const char *kSettingsTitle = "Album Folder Settings";
@@ -42,8 +69,38 @@ static const char *kSettingsTitle = "Album Folder Settings";
 static const uint32 kMsgAlbumFolderSettings = 'pAFA';
 static const uint32 kMsgCreateCoverIconsChanged = 'cCic';
 
-static const int32 kAudioFile = 1;
-static const int32 kImageFile = 2;
+// the part of the next file that is read ahead while handling the current one
+static const off_t kReadAheadSize = 65536;
+// what the Media Kit is assumed to read to find the length of a song
+static const size_t kMediaKitReadSize = 65536;
+
+// remembers why a directory is no album, see rememberRejected()
+static const char *kRejectedAttribute = "albumattr:rejected";
+static const int32 kRejectedVersion = 1;
+
+enum reject_reason {
+	kRejectedTooFewFiles = 1,
+	kRejectedDifferentArtists
+};
+
+struct rejected_directory {
+	int32	version;
+	int32	reason;
+	int64	modified;
+	int32	entries;
+	int32	sub_directories;
+	int32	result;
+};
+
+// the number of waiting icon jobs per icon worker
+static const int32 kIconJobsPerWorker = 4;
+
+// in Tracker, the attributes of a folder should be there after this time
+static const bigtime_t kTrackerFolderBudget = 250000;
+
+// the limits of --background, unless they are given explicitly
+static const int64 kBackgroundReadRate = 8 * 1024 * 1024;
+static const int32 kBackgroundFileRate = 100;
 
 class SettingsWindow : public BWindow {
 	public:
@@ -55,26 +112,37 @@ class SettingsWindow : public BWindow {
 	private:
 		BCheckBox *fUseMediaKit, *fCreateCoverIcons;
 		BCheckBox *fAllowDifferentArtists, *fUseImageIcon;
-		BCheckBox *fRecursive;
+		BCheckBox *fRecursive, *fIsolate;
 };
 
-struct album_attrs {
-	BString artist;
-	BString album;
-	BString genre;
-	int32 length;
-	int32 min_year;
-	int32 max_year;
-	BBitmap* cover;
+struct directory_entry {
+	const char*	name;
+	ino_t		node;
+	bool		is_directory;
+	bool		length_only;	// left out of the sample
+	bool		length_skipped;	// the time budget was used up before it
+	status_t	status;
+	int32		file_type;
+	audio_attrs	attrs;
 };
 
-struct audio_attrs {
-	BString artist;
-	BString album;
-	BString genre;
-	int32 length;
-	int32 year;
-	BBitmap* cover;
+typedef ArenaList<directory_entry> EntryList;
+
+/*!	Deletes the covers decoded for the entries of a directory, including
+	the one that has become the cover of the album, when the scan of the
+	directory is done.
+*/
+class CoverDeleter {
+	public:
+		CoverDeleter(EntryList &entries) : fEntries(entries) {}
+		~CoverDeleter()
+		{
+			for (int32 i = 0; i < fEntries.Count(); i++)
+				delete fEntries[i].attrs.cover;
+		}
+
+	private:
+		EntryList	&fEntries;
 };
 
 
@@ -89,6 +157,31 @@ bool gForce = false;
 bool gUseMediaKit = true;
 bool gFromShell = false;
 bool gHasSeenSettings = false;
+bool gDryRun = false;			// don't write anything back
+const char *gExportPath = NULL;
+export_format gExportFormat = kExportNDJSON;
+bool gResume = false;			// continue an interrupted run
+const char *gJournalPath = NULL;
+const char *gCataloguePath = NULL;
+int32 gPrefetchDepth = 4;		// number of files read ahead, 0 to disable
+__thread Prefetcher *gPrefetcher = NULL;	// every worker has its own
+__thread ArenaCache *gArenaCache = NULL;	// the same
+int32 gVolumeJobs = 1;			// roots scanned at once per volume
+IconQueue *gIconQueue = NULL;	// creates the icons later, if there is one
+int32 gIconJobs = -1;			// icon workers, -1 for one per CPU
+int32 gSampleSize = 0;			// files looked at in huge folders, 0 for all
+bigtime_t gFolderBudget = 0;	// time until the Media Kit is no longer asked
+int64 gMaxReadRate = 0;			// bytes per second, 0 for no limit
+int32 gMaxFileRate = 0;			// files per second, 0 for no limit
+bool gBackground = false;		// low priority, and adaptive I/O limits
+bigtime_t gDecoderTimeout = 10000000;	// per decoder call, 0 for no limit
+bool gIsolate = false;			// try decoders in a helper process first
+const char *gQuarantinePath = NULL;
+const char *gProbe = NULL;		// we are the helper process of another run
+int gProbeOutput = STDOUT_FILENO;	// where the helper sends its result
+BMessage *gFollowUp = NULL;		// albums the add-on leaves to a helper
+BLocker gFollowUpLock("follow-up");
+bool gFollowUpRun = false;		// we are that helper
 
 BRect gSettingsWindowPosition(150, 150, 200, 200);
 
@@ -141,6 +234,7 @@ saveSettings()
 	save.AddBool("use media kit", gUseMediaKit);
 	save.AddBool("create cover icons", gCreateCoverIcons);
 	save.AddBool("use image icon", gUseImageIcon);
+	save.AddBool("isolate decoders", gIsolate);
 
 	return save.Flatten(&file);
 }
@@ -187,6 +281,7 @@ readSettings()
 	readBool(load, "use media kit", gUseMediaKit);
 	readBool(load, "create cover icons", gCreateCoverIcons);
 	readBool(load, "use image icon", gUseImageIcon);
+	readBool(load, "isolate decoders", gIsolate);
 
 	return B_OK;
 }
@@ -207,127 +302,490 @@ writeAttributeString(BNode &node, const char *attribute, const char *value, bool
 	}
 
 	ssize_t size = node.WriteAttr(attribute, B_STRING_TYPE, 0, value, strlen(value) + 1);
-	return size >= 0 ? B_OK : size;
+	if (size < 0)
+		return size;
+
+	stats_count(kCounterAttributesWritten);
+	return B_OK;
 }
 
 
 status_t
-readAttributeString(BNode &node, const char *attribute, BString &string)
+readAttributeString(BNode &node, const char *attribute, char *buffer, size_t size)
 {
-	char *buffer = string.LockBuffer(1024);
-	ssize_t size = node.ReadAttr(attribute, B_STRING_TYPE, 0, buffer, 1024);
-	buffer[1023] = '\0';
-	string.UnlockBuffer();
-
-	if (size < B_OK)
-		return size;
+	ssize_t bytesRead = node.ReadAttr(attribute, B_STRING_TYPE, 0, buffer, size - 1);
+	if (bytesRead < B_OK) {
+		buffer[0] = '\0';
+		return bytesRead;
+	}
 
+	buffer[bytesRead] = '\0';
 	return B_OK;
 }
 
 
+int32
+lengthFromMediaKit(const entry_ref &ref)
+{
+	BMediaFile mediaFile(&ref);
+	if (mediaFile.InitCheck() != B_OK)
+		return 0;
+
+	int32 length = 0;
+	int32 numTracks = mediaFile.CountTracks();
+
+	for (int32 i = 0; i < numTracks; i++) {
+		BMediaTrack *track = mediaFile.TrackAt(i);
+		if (track == NULL)
+			continue;
+
+		media_format format;
+		if (track->EncodedFormat(&format) == B_OK
+			&& format.type == B_MEDIA_ENCODED_AUDIO)
+		{
+			//audioAttrs->bitrate = (int32)(format.u.encoded_audio.bit_rate / 1000);
+			length = track->Duration() / 1000000;
+			//audioAttrs->framerate = format.u.encoded_audio.output.frame_rate;
+		}
+		mediaFile.ReleaseTrack(track);
+	}
+
+	return length;
+}
+
+
+class MediaLengthJob : public WatchdogJob {
+	public:
+		MediaLengthJob(const entry_ref &ref)
+			: fRef(ref), fLength(0) {}
+
+		virtual void Run() { fLength = lengthFromMediaKit(fRef); }
+		int32 Length() const { return fLength; }
+
+	private:
+		entry_ref	fRef;
+		int32		fLength;
+};
+
+
+/*!	Decodes an image from a file, from a region of a file, or from a copy
+	of the given data.
+*/
+class DecodeJob : public WatchdogJob {
+	public:
+		DecodeJob(const entry_ref &ref)
+			: fRef(ref), fOffset(-1), fData(NULL), fSize(0), fBitmap(NULL) {}
+		DecodeJob(const entry_ref &ref, off_t offset, size_t size)
+			: fRef(ref), fOffset(offset), fData(NULL), fSize(size),
+			fBitmap(NULL) {}
+		DecodeJob(const void *data, size_t size)
+			: fOffset(-1), fData(malloc(size)), fSize(size), fBitmap(NULL)
+		{
+			if (fData != NULL)
+				memcpy(fData, data, size);
+		}
+		virtual ~DecodeJob()
+		{
+			delete fBitmap;
+			free(fData);
+		}
+
+		virtual void Run()
+		{
+			if (fData != NULL) {
+				BMemoryIO memoryIO(fData, fSize);
+				fBitmap = BTranslationUtils::GetBitmap(&memoryIO);
+			} else if (fOffset >= 0) {
+				BFile file(&fRef, B_READ_ONLY);
+				if (file.InitCheck() != B_OK)
+					return;
+
+				FileRegionIO regionIO(&file, fOffset, fSize);
+				fBitmap = BTranslationUtils::GetBitmap(&regionIO);
+			} else if (fSize == 0)
+				fBitmap = BTranslationUtils::GetBitmap(&fRef);
+		}
+
+		/*!	Returns how much of the file the job will read. */
+		off_t FileBytes() const
+		{
+			if (fOffset >= 0)
+				return fSize;
+			if (fData != NULL || fSize != 0)
+				return 0;
+
+			off_t size;
+			BEntry entry(&fRef);
+			return entry.GetSize(&size) == B_OK ? size : 0;
+		}
+
+		BBitmap *DetachBitmap()
+		{
+			BBitmap *bitmap = fBitmap;
+			fBitmap = NULL;
+			return bitmap;
+		}
+
+	private:
+		entry_ref	fRef;
+		off_t		fOffset;
+		void		*fData;
+		size_t		fSize;
+		BBitmap		*fBitmap;
+};
+
+
+/*!	Puts the file at \a path in quarantine if the \a status of a decoder
+	says that it hung or crashed on it, and returns true in this case.
+*/
+bool
+quarantineOnFailure(const char *path, status_t status)
+{
+	if (status == B_TIMED_OUT) {
+		stats_count(kCounterDecoderTimeouts);
+		quarantine_add(path, kQuarantineTimeout);
+		return true;
+	}
+	if (status == kSandboxCrashed) {
+		quarantine_add(path, kQuarantineCrash);
+		return true;
+	}
+
+	return false;
+}
+
+
+bool
+isQuarantined(const char *path)
+{
+	if (!quarantine_contains(path))
+		return false;
+
+	stats_count(kCounterQuarantineSkips);
+	return true;
+}
+
+
+/*!	Runs \a job under the watchdog, and puts the file at \a path in
+	quarantine if it takes too long. If too many decoders are stuck
+	already, the file is skipped, and that is reported.
+*/
 status_t
-retrieveFromID3Tags(BEntry& entry, audio_attrs& audioAttrs)
+runDecoder(WatchdogJob *job, const char *path)
 {
-	BPath path;
-	status_t status = entry.GetPath(&path);
-	if (status != B_OK)
+	status_t status = watchdog_run(job, gDecoderTimeout);
+	if (status == B_BUSY) {
+		stats_count(kCounterDecoderSkips);
+		fprintf(stderr, "Skipped decoding \"%s\": too many decoders are "
+			"stuck.\n", path);
+	} else
+		quarantineOnFailure(path, status);
+
+	return status;
+}
+
+
+int32
+guardedLengthFromMediaKit(BEntry &entry, const char *path)
+{
+	entry_ref ref;
+	if (entry.GetRef(&ref) != B_OK || isQuarantined(path))
+		return 0;
+
+	// the Media Kit reads the file on its own, in a thread that must not be
+	// held up by the throttle, so it is accounted for in advance
+	throttle_open_file();
+	throttle_read(kMediaKitReadSize, 0);
+
+	if (gIsolate) {
+		// the helper process does all the work
+		BMallocIO output;
+		status_t status = sandbox_run("length", path, gDecoderTimeout,
+			output);
+		if (status == B_OK) {
+			BString length((const char *)output.Buffer(),
+				output.BufferLength());
+			return atol(length.String());
+		}
+		if (quarantineOnFailure(path, status))
+			return 0;
+	}
+
+	MediaLengthJob *job = new MediaLengthJob(ref);
+	int32 length = 0;
+	if (runDecoder(job, path) == B_OK)
+		length = job->Length();
+
+	job->Release();
+	return length;
+}
+
+
+/*!	Lets a helper process decode the cover of the file at \a path, and
+	hands over the bitmap it sends back as an archive in \a _bitmap,
+	if it found one.
+*/
+status_t
+isolatedDecode(const char *path, BBitmap *&_bitmap)
+{
+	BMallocIO output;
+	status_t status = sandbox_run("cover", path, gDecoderTimeout, output);
+	if (status != B_OK || output.BufferLength() == 0)
 		return status;
 
-	TagLib::MPEG::File file(path.Path());
-	TagLib::ID3v2::Tag* fileTags = file.ID3v2Tag();
-
-	if (fileTags != NULL) {
-		// Find frame containing pictures
-		TagLib::ID3v2::FrameList frame = fileTags->frameList("APIC");
-		TagLib::ID3v2::AttachedPictureFrame* coverFrame = NULL;
-		if (!frame.isEmpty()) {
-			// Search for the album image
-			// (one frame can contain multiple images)
-			TagLib::ID3v2::FrameList::ConstIterator iterator = frame.begin();
-			for (; iterator != frame.end(); iterator++) {
-				TagLib::ID3v2::AttachedPictureFrame* pictureFrame
-					= static_cast<TagLib::ID3v2::AttachedPictureFrame*>(*iterator);
-				if (pictureFrame->type()
-						== TagLib::ID3v2::AttachedPictureFrame::FrontCover) {
-					coverFrame = pictureFrame;
-				}
-			}
+	BMemoryIO archiveIO(output.Buffer(), output.BufferLength());
+	BMessage archive;
+	if (archive.Unflatten(&archiveIO) != B_OK)
+		return B_OK;
 
-			if (coverFrame != NULL) {
-				BMemoryIO memoryIO(coverFrame->picture().data(),
-					coverFrame->picture().size());
+	BBitmap *bitmap = new BBitmap(&archive);
+	if (bitmap->IsValid())
+		_bitmap = bitmap;
+	else
+		delete bitmap;
 
-				audioAttrs.cover = BTranslationUtils::GetBitmap(&memoryIO);
-			}
+	return B_OK;
+}
+
+
+/*!	Decodes the cover of \a job; with \c gIsolate, the helper process
+	does the decoding instead, and \a job is only run in this process if
+	the helper could not be started.
+*/
+BBitmap *
+guardedDecode(const char *path, DecodeJob *job)
+{
+	BBitmap *bitmap = NULL;
+	if (!isQuarantined(path)) {
+		// like the Media Kit, the decoder is accounted for in advance
+		off_t bytes = job->FileBytes();
+		if (bytes > 0) {
+			throttle_open_file();
+			throttle_read(bytes, 0);
+		}
+
+		status_t status = B_ERROR;
+		if (gIsolate)
+			status = isolatedDecode(path, bitmap);
+
+		if (status != B_OK && !quarantineOnFailure(path, status)
+			&& runDecoder(job, path) == B_OK)
+			bitmap = job->DetachBitmap();
+	}
+
+	job->Release();
+	return bitmap;
+}
+
+
+/*!	Only decodes the cover if \a decodeCover is true; otherwise it is
+	just noted that there is one.
+*/
+void
+retrieveFromID3v2Tag(TagLib::ID3v2::Tag* fileTags, audio_attrs& audioAttrs,
+	const char* path, bool decodeCover)
+{
+	TagLib::ID3v2::AttachedPictureFrame* coverFrame
+		= find_front_cover(fileTags);
+	if (coverFrame != NULL && !decodeCover)
+		audioAttrs.has_cover = true;
+
+	if (coverFrame != NULL && decodeCover) {
+		PhaseTimer timer(kPhaseCoverDecode);
+		audioAttrs.cover = guardedDecode(path,
+			new DecodeJob(coverFrame->picture().data(),
+				coverFrame->picture().size()));
+		if (audioAttrs.cover != NULL) {
+			audioAttrs.has_cover = true;
+			stats_count(kCounterEmbeddedCovers);
 		}
 	}
 
 	// TODO: read other tags, and write them back to the attributes
+}
+
+
+/*!	Lets TagLib read the file through the throttle. */
+class ThrottledFileStream : public TagLib::FileStream {
+	public:
+		ThrottledFileStream(const char *path)
+			: TagLib::FileStream(path, true) {}
+
+		virtual TagLib::ByteVector readBlock(unsigned long length)
+		{
+			bigtime_t start = system_time();
+			TagLib::ByteVector block = TagLib::FileStream::readBlock(length);
+			if (block.size() > 0)
+				throttle_read(block.size(), system_time() - start);
+
+			return block;
+		}
+};
+
+
+status_t
+retrieveFromID3Tags(const char* path, audio_attrs& audioAttrs,
+	const prefetch_buffer* buffer, bool decodeCover)
+{
+	PhaseTimer timer(kPhaseTags);
+
+	if (buffer != NULL && buffer->status == B_OK) {
+		// the prefetcher has already read the whole tag, if there is one
+		size_t tagSize = id3v2_tag_size(buffer->head, buffer->head_size);
+		if (tagSize == 0)
+			return B_OK;
+
+		if (tagSize <= buffer->head_size) {
+			TagLib::ByteVectorStream stream(TagLib::ByteVector(
+				(const char*)buffer->head, tagSize));
+			TagLib::MPEG::File file(&stream,
+				TagLib::ID3v2::FrameFactory::instance(), false);
+
+			retrieveFromID3v2Tag(file.ID3v2Tag(), audioAttrs, path,
+				decodeCover);
+			return B_OK;
+		}
+	}
+
+	ThrottledFileStream stream(path);
+	TagLib::MPEG::File file(&stream, TagLib::ID3v2::FrameFactory::instance(),
+		false);
+	retrieveFromID3v2Tag(file.ID3v2Tag(), audioAttrs, path, decodeCover);
 	return B_OK;
 }
 
 
+/*!	Looks for the cover of FLAC, MP4, and Ogg files, and falls back to
+	the ID3 tags for all other files. Only the picture itself is read
+	from the file, and decoded right from there. \a file is the open
+	\a entry at \a path, if the caller has one already.
+*/
 status_t
-retrieveFromAttrs(BFile& file, audio_attrs& audioAttrs)
+retrieveFromTags(BEntry& entry, const char* path, BFile* file,
+	audio_attrs& audioAttrs, const prefetch_buffer* buffer, bool decodeCover)
 {
-	readAttributeString(file, "Audio:Artist", audioAttrs.artist);
-	readAttributeString(file, "Audio:Album", audioAttrs.album);
-	readAttributeString(file, "Media:Genre", audioAttrs.genre);
-
-	audioAttrs.length = 0;
-	audioAttrs.year = 0;
-
-	if (file.ReadAttr("Media:Year", B_INT32_TYPE, 0, &audioAttrs.year, sizeof(int32)) == sizeof(int32)
-		&& audioAttrs.year != 0 && audioAttrs.year < 100)
-		audioAttrs.year += 1900;
-
-	BString lengthString;
-	char *seconds;
-	if (readAttributeString(file, "Media:Length", lengthString) == B_OK
-		&& lengthString.String() != NULL
-		&& (seconds = strchr(lengthString.String(), ':')) != NULL) {
-		audioAttrs.length = atol(lengthString.String()) * 60 + atol(seconds + 1);
+	BFile ownFile;
+	if (file == NULL) {
+		ownFile.SetTo(&entry, B_READ_ONLY);
+		file = &ownFile;
+	}
+
+	uint8 header[12];
+	size_t headerSize = 0;
+	if (buffer != NULL && buffer->status == B_OK) {
+		headerSize = std::min(buffer->head_size, sizeof(header));
+		memcpy(header, buffer->head, headerSize);
 	} else {
+		bigtime_t start = system_time();
+		ssize_t bytesRead = file->ReadAt(0, header, sizeof(header));
+		if (bytesRead > 0) {
+			headerSize = bytesRead;
+			throttle_read(bytesRead, system_time() - start);
+		}
+	}
+
+	container_type type = identify_container(header, headerSize);
+	if (type == kContainerUnknown)
+		return retrieveFromID3Tags(path, audioAttrs, buffer, decodeCover);
+
+	PhaseTimer timer(kPhaseTags);
+
+	status_t status = file->InitCheck();
+	if (status != B_OK)
+		return status;
+
+	ThrottledIO throttledFile(file);
+	embedded_cover cover;
+	if (find_embedded_cover(throttledFile, type, cover) != B_OK)
+		return B_OK;
+
+	audioAttrs.has_cover = true;
+
+	entry_ref ref;
+	if (decodeCover && entry.GetRef(&ref) == B_OK) {
+		PhaseTimer timer(kPhaseCoverDecode);
+
+		DecodeJob *job;
+		if (cover.data != NULL)
+			job = new DecodeJob(cover.data + cover.offset, cover.size);
+		else
+			job = new DecodeJob(ref, cover.offset, cover.size);
+
+		audioAttrs.cover = guardedDecode(path, job);
+		if (audioAttrs.cover != NULL)
+			stats_count(kCounterEmbeddedCovers);
+		else
+			audioAttrs.has_cover = false;
+	}
+
+	free(cover.data);
+	return B_OK;
+}
+
+
+status_t
+retrieveFromAttrs(BEntry& entry, const char* path, BFile& file,
+	audio_attrs& audioAttrs, Arena& arena, bool useMediaKit)
+{
+	PhaseTimer timer(kPhaseAttributes);
+
+	if (read_track_attributes(file, arena, audioAttrs) != B_OK) {
 		if (gVerbose)
-			fprintf(stderr, "could not read Media:Length from file (%s)\n", lengthString.String());
+			fprintf(stderr, "could not read Media:Length from file\n");
 
 		// retrieve length using the media kit (if we are allowed to)
 
-		if (!gUseMediaKit)
+		if (!useMediaKit)
 			return B_OK;
 
-		file.Seek(0, SEEK_SET);
-		BMediaFile mediaFile(&file);
-
-		if (mediaFile.InitCheck() == B_OK) {
-			int32 numTracks = mediaFile.CountTracks();
-
-			for (int32 i = 0; i < numTracks; i++) {
-				BMediaTrack *track = mediaFile.TrackAt(i);
-				if (track == NULL)
-					continue;
-
-				media_format format;
-				if (track->EncodedFormat(&format) == B_OK
-					&& format.type == B_MEDIA_ENCODED_AUDIO)
-				{
-					//audioAttrs->bitrate = (int32)(format.u.encoded_audio.bit_rate / 1000);
-					audioAttrs.length = track->Duration() / 1000000;
-					//audioAttrs->framerate = format.u.encoded_audio.output.frame_rate;
-				}
-				mediaFile.ReleaseTrack(track);
-			}
-		}
+		PhaseTimer timer(kPhaseMediaKit);
+		stats_count(kCounterMediaKitOpens);
+
+		audioAttrs.length = guardedLengthFromMediaKit(entry, path);
 	}
 
 	return B_OK;
 }
 
 
+/*!	Fills in the attributes that are still missing from the ID3v1, Lyrics3,
+	and APEv2 tags at the end of the file. They are parsed right from the
+	prefetched tail, or else from a single read of it.
+*/
+void
+retrieveFromTailTags(BFile& file, audio_attrs& audioAttrs, Arena& arena,
+	const prefetch_buffer* buffer)
+{
+	if (!tail_tags_needed(audioAttrs))
+		return;
+
+	PhaseTimer timer(kPhaseTags);
+
+	if (buffer != NULL && buffer->status == B_OK) {
+		if (buffer->tail_size > 0) {
+			parse_tail_tags(buffer->tail, buffer->tail_size, arena,
+				audioAttrs);
+			return;
+		}
+		if ((off_t)buffer->head_size == buffer->file_size) {
+			parse_tail_tags(buffer->head, buffer->head_size, arena,
+				audioAttrs);
+			return;
+		}
+	}
+
+	bigtime_t start = system_time();
+	ssize_t bytesRead = read_tail_tags(file, arena, audioAttrs);
+	if (bytesRead > 0)
+		throttle_read(bytesRead, system_time() - start);
+}
+
+
 int32
 getFileType(BEntry &entry)
 {
+	PhaseTimer timer(kPhaseFileType);
+
 	char buffer[B_ATTR_NAME_LENGTH];
 	BNode node(&entry);
 	BNodeInfo info(&node);
@@ -352,17 +810,25 @@ getFileType(BEntry &entry)
 }
 
 
+/*!	Reads what there is to know about the file \a name in the directory
+	at \a directory. Its path is only put together on the stack, and the
+	file is opened once for all of its attributes and tags.
+*/
 status_t
-handleFile(BEntry &entry, audio_attrs &audioAttrs, int32 &fileType)
+handleFile(BEntry &entry, const char *directory, const char *name,
+	audio_attrs &audioAttrs, int32 &fileType, Arena &arena, bool useMediaKit,
+	const prefetch_buffer *buffer = NULL)
 {
-	char name[B_FILE_NAME_LENGTH];
-	entry.GetName(name);
+	char path[B_PATH_NAME_LENGTH];
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
 
 	audioAttrs.cover = NULL;
+	audioAttrs.has_cover = false;
 
 	// if it is not an audio file, return
 
-	fileType = getFileType(entry);
+	stats_count(kCounterFiles);
+	fileType = buffer != NULL ? buffer->file_type : getFileType(entry);
 	if (fileType != kAudioFile) {
 		if (gVerbose)
 			fprintf(stderr, "'%s' is not an audio file\n", name);
@@ -371,41 +837,50 @@ handleFile(BEntry &entry, audio_attrs &audioAttrs, int32 &fileType)
 
 	// Open File (on error, return showing error)
 
+	if (buffer == NULL)
+		throttle_open_file();
+
 	BFile file(&entry, B_READ_ONLY);
 	if (file.InitCheck() < B_OK) {
 		fprintf(stderr, "could not open '%s'.\n", name);
 		return B_IO_ERROR;
 	}
 
+	stats_count(kCounterAudioFiles);
+
 	// retrieve attributes
 
-	status_t status = retrieveFromAttrs(file, audioAttrs);
-	if (status == B_OK)
-		retrieveFromID3Tags(entry, audioAttrs);
+	// the cover is only needed when its icons are created right away
+	bool decodeCover = gCreateCoverIcons && !gDryRun && gIconQueue == NULL
+		&& gFollowUp == NULL;
+
+	status_t status = retrieveFromAttrs(entry, path, file, audioAttrs, arena,
+		useMediaKit);
+	if (status == B_OK) {
+		retrieveFromTailTags(file, audioAttrs, arena, buffer);
+		retrieveFromTags(entry, path, &file, audioAttrs, buffer, decodeCover);
+	}
 	return status;
 }
 
 
 void
-createIcon(BNodeInfo& targetInfo, BNodeInfo* imageInfo, BBitmap* source, icon_size type)
+createIcon(BNodeInfo& targetInfo, BNodeInfo* imageInfo,
+	const IconPyramid& pyramid, icon_size type)
 {
-	BBitmap icon(BRect(0, 0, type - 1, type - 1), B_COLOR_8_BIT, true);
+	PhaseTimer timer(kPhaseCreateIcons);
+
+	BBitmap icon(BRect(0, 0, type - 1, type - 1), B_COLOR_8_BIT);
 	if (targetInfo.GetIcon(&icon, type) == B_OK && !gForce)
 		return;
 
 	if (!gUseImageIcon || imageInfo == NULL || imageInfo->GetIcon(&icon, type) != B_OK) {
-		BView *view = new BView(icon.Bounds(), "icon", B_FOLLOW_NONE, 0);
-
-		icon.AddChild(view);
-		icon.Lock();
-
-		view->DrawBitmap(source, icon.Bounds());
-		view->Sync();
-
-		icon.Unlock();
+		icon.ImportBits(pyramid.Bits(type), pyramid.BitsLength(type),
+			pyramid.BytesPerRow(type), 0, B_RGBA32);
 	}
 
-	targetInfo.SetIcon(&icon, type);
+	if (targetInfo.SetIcon(&icon, type) == B_OK)
+		stats_count(kCounterIconsWritten);
 }
 
 
@@ -428,12 +903,25 @@ createCoverIcons(BEntry& target, BBitmap* image, entry_ref* imageRef)
 			return;
 		}
 
-		image = BTranslationUtils::GetBitmap(imageRef);
+		PhaseTimer timer(kPhaseCoverDecode);
+		BPath path(imageRef);
+		image = guardedDecode(path.Path(), new DecodeJob(*imageRef));
 	}
 
 	if (image != NULL) {
-		createIcon(targetInfo, imageInfo, image, B_MINI_ICON);
-		createIcon(targetInfo, imageInfo, image, B_LARGE_ICON);
+		// all sizes are scaled down from the one decoded cover
+		IconPyramid pyramid;
+		status_t status;
+		{
+			PhaseTimer timer(kPhaseCreateIcons);
+			status = pyramid.SetTo(image);
+		}
+
+		if (status == B_OK) {
+			createIcon(targetInfo, imageInfo, pyramid, B_MINI_ICON);
+			createIcon(targetInfo, imageInfo, pyramid, B_LARGE_ICON);
+		}
+
 		if (imageRef != NULL)
 			delete image;
 	}
@@ -443,143 +931,581 @@ createCoverIcons(BEntry& target, BBitmap* image, entry_ref* imageRef)
 
 
 int32
-countWordOccurences(const char *string, const char *word)
+collectImages(BEntry &entry, BMessage &images)
 {
-	size_t wordLength = strlen(word);
+	PhaseTimer timer(kPhaseCollectImages);
+
+	BDirectory directory(&entry);
+	entry_ref ref;
+
 	int32 count = 0;
 
-	while (string[0]) {
-		if (!strncasecmp(string, word, wordLength)) {
+	directory.Rewind();
+	while (directory.GetNextRef(&ref) == B_OK) {
+		BEntry sub(&ref, false);
+		if (sub.IsDirectory()) {
+			count += collectImages(sub, images);
+			continue;
+		}
+
+		// the type is read from the inode of the file
+		throttle_open_file();
+		if (getFileType(sub) == kImageFile) {
+			images.AddRef("refs", &ref);
+			stats_count(kCounterImageFiles);
 			count++;
-			string += wordLength;
-		} else
-			string++;
+		}
 	}
 
 	return count;
 }
 
 
+void
+formatLength(char *buffer, int32 length)
+{
+	sprintf(buffer, "%02" B_PRId32 ":%02" B_PRId32, length / 60, length % 60);
+}
+
+
+void
+formatYears(char *buffer, int32 minYear, int32 maxYear)
+{
+	if (minYear == maxYear)
+		sprintf(buffer, "%4" B_PRId32, minYear);
+	else
+		sprintf(buffer, "%4" B_PRId32 "-%4" B_PRId32, minYear, maxYear);
+}
+
+
+/*!	Parses what formatLength() and formatYears() have written. */
+int32
+parseLength(const char *string)
+{
+	const char *seconds = strchr(string, ':');
+	if (seconds == NULL)
+		return 0;
+
+	return atol(string) * 60 + atol(seconds + 1);
+}
+
+
+void
+parseYears(const char *string, int32 &minYear, int32 &maxYear)
+{
+	minYear = maxYear = atol(string);
+
+	const char *separator = strchr(string, '-');
+	if (separator != NULL)
+		maxYear = atol(separator + 1);
+}
+
+
+void
+addToCollection(collection_attrs &collection, const char *genre,
+	int32 length, int32 minYear, int32 maxYear)
+{
+	collection.albums++;
+	collection.length += length;
+
+	if (minYear != 0
+		&& (collection.min_year == 0 || minYear < collection.min_year))
+		collection.min_year = minYear;
+	if (maxYear > collection.max_year)
+		collection.max_year = maxYear;
+
+	if (genre != NULL && genre[0])
+		collection.genres[genre]++;
+}
+
+
+void
+mergeCollection(collection_attrs &target, const collection_attrs &source)
+{
+	if (source.incomplete)
+		target.incomplete = true;
+	if (source.albums == 0)
+		return;
+
+	target.albums += source.albums;
+	target.length += source.length;
+
+	if (source.min_year != 0
+		&& (target.min_year == 0 || source.min_year < target.min_year))
+		target.min_year = source.min_year;
+	if (source.max_year > target.max_year)
+		target.max_year = source.max_year;
+
+	std::map<BString, int32>::const_iterator iterator
+		= source.genres.begin();
+	for (; iterator != source.genres.end(); iterator++)
+		target.genres[iterator->first] += iterator->second;
+}
+
+
+/*!	Writes the rollup of all albums below a directory that is no album
+	itself. Unlike the album attributes, these are always replaced, as
+	they change whenever one of the albums changes.
+*/
+void
+writeCollection(BNode &node, const collection_attrs &collection)
+{
+	PhaseTimer timer(kPhaseWriteAttributes);
+
+	if (node.WriteAttr("Collection:Albums", B_INT32_TYPE, 0,
+			&collection.albums, sizeof(int32)) == sizeof(int32))
+		stats_count(kCounterAttributesWritten);
+
+	char buffer[64];
+	formatLength(buffer, collection.length);
+	writeAttributeString(node, "Collection:Length", buffer, true);
+
+	if (collection.min_year != 0 && collection.max_year != 0) {
+		formatYears(buffer, collection.min_year, collection.max_year);
+		writeAttributeString(node, "Collection:Year", buffer, true);
+	} else
+		node.RemoveAttr("Collection:Year");
+
+	// the genre most of the albums have
+	const char *genre = NULL;
+	int32 genreAlbums = 0;
+	std::map<BString, int32>::const_iterator iterator
+		= collection.genres.begin();
+	for (; iterator != collection.genres.end(); iterator++) {
+		if (iterator->second > genreAlbums) {
+			genre = iterator->first.String();
+			genreAlbums = iterator->second;
+		}
+	}
+
+	if (genre != NULL)
+		writeAttributeString(node, "Collection:Genre", genre, true);
+	else
+		node.RemoveAttr("Collection:Genre");
+}
+
+
+/*!	Reads back the album, or the rollup of the albums below it, of a
+	directory that has been done by an earlier run. Only the dominant
+	genre of a rollup is known, so all of its albums are counted for it.
+*/
+void
+readCollection(BNode &node, collection_attrs &collection)
+{
+	char type[B_MIME_TYPE_LENGTH];
+	char genre[256];
+	char buffer[64];
+	int32 minYear = 0;
+	int32 maxYear = 0;
+
+	BNodeInfo info(&node);
+	if (info.GetType(type) == B_OK && !strcmp(type, kAlbumMimeString)) {
+		readAttributeString(node, "Album:Genre", genre, sizeof(genre));
+		readAttributeString(node, "Album:Length", buffer, sizeof(buffer));
+		int32 length = parseLength(buffer);
+		if (readAttributeString(node, "Album:Year", buffer, sizeof(buffer)) == B_OK)
+			parseYears(buffer, minYear, maxYear);
+
+		addToCollection(collection, genre, length, minYear, maxYear);
+		collection.is_album = true;
+		return;
+	}
+
+	int32 albums;
+	if (node.ReadAttr("Collection:Albums", B_INT32_TYPE, 0, &albums,
+			sizeof(int32)) != sizeof(int32) || albums <= 0)
+		return;
+
+	collection.albums += albums;
+	if (readAttributeString(node, "Collection:Length", buffer, sizeof(buffer)) == B_OK)
+		collection.length += parseLength(buffer);
+	if (readAttributeString(node, "Collection:Year", buffer, sizeof(buffer)) == B_OK) {
+		parseYears(buffer, minYear, maxYear);
+		collection.min_year = minYear;
+		collection.max_year = maxYear;
+	}
+	if (readAttributeString(node, "Collection:Genre", genre, sizeof(genre)) == B_OK)
+		collection.genres[genre] += albums;
+}
+
+
+bool handleDirectory(BEntry &entry, int32 level,
+	collection_attrs *parent = NULL);
+
+
+/*!	Stores in an attribute of the directory why it is no album, together
+	with its modification time from before the scan, so that the next run
+	can skip it until its contents change; writing an attribute does not
+	change the modification time of the directory.
+*/
+void
+rememberRejected(BNode &node, time_t modified, reject_reason reason,
+	int32 entries, int32 subDirectories, bool result)
+{
+	if (gDryRun)
+		return;
+
+	rejected_directory rejected;
+	rejected.version = kRejectedVersion;
+	rejected.reason = reason;
+	rejected.modified = modified;
+	rejected.entries = entries;
+	rejected.sub_directories = subDirectories;
+	rejected.result = result;
+
+	node.WriteAttr(kRejectedAttribute, B_RAW_TYPE, 0, &rejected,
+		sizeof(rejected));
+}
+
+
+/*!	Checks if the directory has been rejected by an earlier run, and has
+	not been changed since. Its files are not looked at again; only its
+	sub-directories are still visited in recursive mode.
+*/
+bool
+lookupRejected(BEntry &entry, int32 level, bool &_result,
+	collection_attrs &collection)
+{
+	if (gForce)
+		return false;
+
+	BNode node(&entry);
+	rejected_directory rejected;
+	time_t modified;
+	if (node.ReadAttr(kRejectedAttribute, B_RAW_TYPE, 0, &rejected,
+			sizeof(rejected)) != (ssize_t)sizeof(rejected)
+		|| rejected.version != kRejectedVersion
+		|| entry.GetModificationTime(&modified) != B_OK
+		|| rejected.modified != modified)
+		return false;
+
+	// the options may no longer reject it, and in Tracker, the user is
+	// asked what to do with it
+	if (rejected.reason == kRejectedDifferentArtists
+		&& (gAllowDifferentArtists || !gFromShell))
+		return false;
+
+	// the modification time only has a resolution of a second
+	BDirectory directory(&entry);
+	if (directory.CountEntries() != rejected.entries)
+		return false;
+
+	stats_count(kCounterRejectedSkips);
+
+	if (gRecursive && rejected.sub_directories > 0) {
+		directory.Rewind();
+		BEntry subDirectory;
+		while (directory.GetNextEntry(&subDirectory) == B_OK) {
+			if (subDirectory.IsDirectory())
+				handleDirectory(subDirectory, level + 1, &collection);
+		}
+	}
+
+	_result = rejected.result != 0;
+	return true;
+}
+
+
+bool
+compareNodes(const directory_entry *a, const directory_entry *b)
+{
+	return a->node < b->node;
+}
+
+
+/*!	Reads all entries of the directory at once, without touching their
+	inodes, so that they can be visited in the order they have on disk.
+*/
 status_t
-chooseCover(BMessage &refs, entry_ref &chosen)
+readDirectoryEntries(BDirectory &directory, EntryList &entries, Arena &arena)
 {
+	PhaseTimer timer(kPhaseReadDirectory);
+
+	int64 buffer[512];
+	struct dirent *dirents = (struct dirent *)buffer;
 	int32 count;
-	refs.GetInfo("refs", NULL, &count);
 
-	// are there any candidates at all?
-	if (count == 0)
-		return B_ENTRY_NOT_FOUND;
+	directory.Rewind();
+	while ((count = directory.GetNextDirents(dirents, sizeof(buffer))) > 0) {
+		struct dirent *dirent = dirents;
+
+		for (int32 i = 0; i < count; i++) {
+			if (strcmp(dirent->d_name, ".") && strcmp(dirent->d_name, "..")) {
+				directory_entry *entry = entries.Add();
+				if (entry == NULL)
+					return B_NO_MEMORY;
+
+				entry->name = arena.Copy(dirent->d_name);
+				if (entry->name == NULL)
+					return B_NO_MEMORY;
+
+				entry->node = dirent->d_ino;
+				entry->is_directory = false;
+				entry->status = B_ERROR;
+				entry->file_type = -1;
+			}
+
+			dirent = (struct dirent *)((uint8 *)dirent + dirent->d_reclen);
+		}
+	}
 
-	// if there is only one image, we have a clear candidate
-	if (count == 1)
-		return refs.FindRef("refs", &chosen);
+	return count < 0 ? count : B_OK;
+}
 
-	const char *words[] = {"cover", "front", "album"};
-	int32 wordCount = sizeof(words) / sizeof(const char *);
 
-	const char *stopWords[] = {"back", "cd", "inlay", "inside", "logo", "single", "alternative"};
-	int32 stopWordCount = sizeof(stopWords) / sizeof(const char *);
+/*!	Lets the file system know that we are going to read the header of
+	the file soon, so that it can be read in while we are busy with the
+	current one.
+*/
+void
+readAheadHeader(const BPath &directory, const char *name)
+{
+#ifdef POSIX_FADV_WILLNEED
+	char path[B_PATH_NAME_LENGTH];
+	snprintf(path, sizeof(path), "%s/%s", directory.Path(), name);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
 
-	int32 score[count];
-	memset(score, 0, sizeof(score));
+	posix_fadvise(fd, 0, kReadAheadSize, POSIX_FADV_WILLNEED);
+	close(fd);
+#endif
+}
 
-	// compute the score
 
-	entry_ref ref;
-	for (int32 i = 0; refs.FindRef("refs", i, &ref) == B_OK; i++) {
-		BPath path(&ref);
-		if (path.InitCheck() != B_OK)
+/*!	Handles the \a count files in \a schedule, in the order of their inodes,
+	which on BFS is their position on disk, to avoid seeking back and forth
+	between them; the results are still combined in directory order later.
+	\a names must have room for \a count names.
+*/
+void
+handleEntries(BDirectory &directory, const BPath &path,
+	directory_entry **schedule, const char **names, int32 count,
+	Arena &arena, bigtime_t budgetEnd)
+{
+	std::sort(schedule, schedule + count, compareNodes);
+
+	// The prefetcher reads the next files in a separate thread, while we
+	// are parsing the current one.
+
+	for (int32 i = 0; i < count; i++)
+		names[i] = schedule[i]->name;
+
+	bool prefetch = gPrefetcher != NULL && count > 0
+		&& gPrefetcher->Start(path, names, count) == B_OK;
+
+	for (int32 i = 0; i < count; i++) {
+		directory_entry &current = *schedule[i];
+		const prefetch_buffer *buffer = NULL;
+
+		if (prefetch)
+			buffer = gPrefetcher->Next();
+		else if (i + 1 < count)
+			readAheadHeader(path, schedule[i + 1]->name);
+
+		BEntry fileEntry(&directory, current.name, false);
+		current.is_directory = buffer != NULL
+			? buffer->is_directory : fileEntry.IsDirectory();
+		if (!current.is_directory) {
+			bool useMediaKit = gUseMediaKit && system_time() < budgetEnd;
+			current.status = handleFile(fileEntry, path.Path(), current.name,
+				current.attrs, current.file_type, arena, useMediaKit, buffer);
+			current.length_skipped = gUseMediaKit && !useMediaKit
+				&& current.file_type == kAudioFile
+				&& current.attrs.length == 0;
+		}
+
+		if (buffer != NULL)
+			gPrefetcher->Recycle();
+	}
+
+	if (prefetch)
+		gPrefetcher->Finish();
+}
+
+
+/*!	Reads only the type and the Media:Length attribute of the files in the
+	directory; both are small enough to be stored in the inode on BFS. If
+	there are enough audio files with a length, all but an evenly spread
+	sample of \a sampleSize of them are marked as "length only", and are
+	not looked at any further. Returns the number of these files.
+*/
+int32
+readLengthsOnly(BDirectory &directory, EntryList &entries, int32 sampleSize)
+{
+	PhaseTimer timer(kPhaseAttributes);
+
+	int32 count = entries.Count();
+	int32 candidates = 0;
+
+	for (int32 i = 0; i < count; i++) {
+		directory_entry &current = entries[i];
+
+		BNode node(&directory, current.name);
+		BNodeInfo info(&node);
+		char type[B_MIME_TYPE_LENGTH];
+		char length[64];
+		char *seconds;
+		if (node.InitCheck() != B_OK || info.GetType(type) != B_OK
+			|| strncmp(type, "audio/", 6)
+			|| readAttributeString(node, "Media:Length", length,
+				sizeof(length)) != B_OK
+			|| (seconds = strchr(length, ':')) == NULL)
 			continue;
 
-		for (int32 j = 0; j < wordCount; j++)
-			score[i] += countWordOccurences(path.Path(), words[j]) * 2;
-
-		// negative words have higher impact
-		for (int32 j = 0; j < stopWordCount; j++)
-			score[i] -= countWordOccurences(path.Path(), stopWords[j]) * 3;
+		current.length_only = true;
+		current.file_type = kAudioFile;
+		current.status = B_OK;
+		current.attrs.length = atol(length) * 60 + atol(seconds + 1);
+		candidates++;
 	}
 
-	// find the entry with the highest score
-
-	int32 bestIndex = 0;
-	int32 bestCount = 1;
-	int32 bestScore = score[0];
+	int32 stride = candidates / sampleSize;
+	int32 sampled = 0;
+	int32 index = 0;
 
-	for (int32 i = 1; i < count; i++) {
-		if (bestScore < score[i]) {
-			bestIndex = i;
-			bestScore = score[i];
-			bestCount = 1;
-		} else if (bestScore == score[i])
-			bestCount++;
-	}
+	for (int32 i = 0; i < count; i++) {
+		directory_entry &current = entries[i];
+		if (!current.length_only)
+			continue;
 
-	if (bestCount > 1) {
-		// damn, we couldn't decide
-		return B_ERROR;
+		if (stride < 2 || index % stride == 0 || index == candidates - 1) {
+			current.length_only = false;
+			sampled++;
+		}
+		index++;
 	}
 
-	return refs.FindRef("refs", bestIndex, &chosen);
+	return candidates - sampled;
 }
 
 
-int32
-collectImages(BEntry &entry, BMessage &images)
+/*!	Returns whether all audio files that have been looked at closely agree
+	on the artist and album.
+*/
+bool
+sampleAgrees(EntryList &entries)
 {
-	BDirectory directory(&entry);
-	entry_ref ref;
+	const char *artist = NULL;
+	const char *album = NULL;
 
-	int32 count = 0;
+	for (int32 i = 0; i < entries.Count(); i++) {
+		directory_entry &current = entries[i];
+		if (current.length_only || current.is_directory
+			|| current.status < B_OK || current.file_type != kAudioFile)
+			continue;
 
-	directory.Rewind();
-	while (directory.GetNextRef(&ref) == B_OK) {
-		BEntry sub(&ref, false);
-		if (sub.IsDirectory()) {
-			count += collectImages(sub, images);
-		} else if (getFileType(sub) == kImageFile) {
-			images.AddRef("refs", &ref);
-			count++;
-		}
+		// the strings are interned, and can be compared by their pointers
+		if (artist == NULL) {
+			artist = current.attrs.artist;
+			album = current.attrs.album;
+		} else if (current.attrs.artist != artist
+			|| current.attrs.album != album)
+			return false;
 	}
 
-	return count;
+	return true;
 }
 
 
 bool
-handleDirectory(BEntry &entry, int32 level)
+scanDirectory(BEntry &entry, const BPath &path, int32 level,
+	collection_attrs &collection)
 {
-	BPath path(&entry);
-
 	if (!entry.IsDirectory()) {
 		fprintf(stderr, "\"%s\" is not a directory\n", path.Path());
 		return false;
 	}
 
+	DirectoryTimer directoryTimer(path.Path());
+	catalogue_visit(path.Path());
+
 	BDirectory directory(&entry);
-	BEntry entryIterator;
 
-	album_attrs albumAttrs;
-	albumAttrs.length = 0;
-	albumAttrs.min_year = 0;
-	albumAttrs.max_year = 0;
-	albumAttrs.cover = NULL;
+	time_t modified = 0;
+	entry.GetModificationTime(&modified);
+
+	// All strings of this directory are interned in its arena, so that
+	// they can be compared by their pointers.
+	Arena arena(gArenaCache);
+	AlbumAggregator aggregator(arena);
+	if (aggregator.InitCheck() != B_OK)
+		return false;
 
+	album_attrs albumAttrs;
 	BMessage images;
 
-	int32 numAudioFiles = 0;
-	bool differentArtists = false;
-	bool differentAlbums = false;
+	int32 numSubDirectories = 0;
+	bool lengthSkipped = false;
 
-	directory.Rewind();
-	while (directory.GetNextEntry(&entryIterator, false) == B_OK) {
-		audio_attrs audioAttrs;
+	EntryList entries(arena);
+	CoverDeleter coverDeleter(entries);
+	status_t status = readDirectoryEntries(directory, entries, arena);
+	if (status != B_OK) {
+		fprintf(stderr, "Could not read directory \"%s\": %s\n", path.Path(),
+			strerror(status));
+		return false;
+	}
+	int32 count = entries.Count();
+
+	directory_entry **schedule = (directory_entry **)arena.Allocate(
+		count * sizeof(directory_entry *));
+	const char **names = (const char **)arena.Allocate(
+		count * sizeof(const char *));
+	if (schedule == NULL || names == NULL)
+		return false;
+
+	// In huge folders, only a sample of the files is looked at closely,
+	// as long as it agrees on the artist and album.
+	int32 lengthOnly = 0;
+	if (gSampleSize > 0 && count > gSampleSize * 2)
+		lengthOnly = readLengthsOnly(directory, entries, gSampleSize);
+
+	// With a time budget, the Media Kit is no longer asked once it is used
+	// up; the album length is then left for a later run to fill in.
+	bigtime_t budgetEnd = gFolderBudget > 0
+		? system_time() + gFolderBudget : B_INFINITE_TIMEOUT;
+
+	int32 scheduled = 0;
+	for (int32 i = 0; i < count; i++) {
+		if (!entries[i].length_only)
+			schedule[scheduled++] = &entries[i];
+	}
+
+	handleEntries(directory, path, schedule, names, scheduled, arena,
+		budgetEnd);
+
+	if (lengthOnly > 0 && !sampleAgrees(entries)) {
+		// the sample is not enough, we need to look at every file
+		if (gVerbose)
+			fprintf(stderr, "Directory at \"%s\" failed the sample check.\n", path.Path());
+
+		stats_count(kCounterSampleEscalations);
+		scheduled = 0;
+		for (int32 i = 0; i < count; i++) {
+			if (entries[i].length_only) {
+				entries[i].length_only = false;
+				schedule[scheduled++] = &entries[i];
+			}
+		}
+
+		handleEntries(directory, path, schedule, names, scheduled, arena,
+			budgetEnd);
+	} else if (lengthOnly > 0)
+		stats_count(kCounterUnsampledTracks, lengthOnly);
 
-		if (entryIterator.IsDirectory()) {
+	for (int32 i = 0; i < count; i++) {
+		directory_entry &current = entries[i];
+
+		if (current.is_directory) {
 			bool wasAlbum = false;
+			numSubDirectories++;
 
-			if (gRecursive)
-				wasAlbum = handleDirectory(entryIterator, level + 1);
+			if (gRecursive) {
+				BEntry subDirectory(&directory, current.name, false);
+				wasAlbum = handleDirectory(subDirectory, level + 1, &collection);
+			}
 
 			if (wasAlbum && !gRecursive) {
 				// if the sub-directory was an album, this won't be one
@@ -589,52 +1515,39 @@ handleDirectory(BEntry &entry, int32 level)
 			continue;
 		}
 
-		int32 fileType;
-		if (handleFile(entryIterator, audioAttrs, fileType) < B_OK)
+		if (current.status < B_OK)
 			continue;
 
-		if (fileType == kAudioFile) {
-			if (numAudioFiles++ == 0) {
-				// initialize album attributes
-				albumAttrs.artist = audioAttrs.artist;
-				albumAttrs.album = audioAttrs.album;
-				albumAttrs.min_year = albumAttrs.max_year = audioAttrs.year;
-				albumAttrs.genre = audioAttrs.genre;
-			} else if (albumAttrs.artist != audioAttrs.artist)
-				differentArtists = true;
-			else if (albumAttrs.album != audioAttrs.album)
-				differentAlbums = true;
-
-			if (!audioAttrs.genre.ICompare("Soundtrack"))
-				albumAttrs.genre = "Soundtrack";
-			else if (audioAttrs.genre != albumAttrs.genre)
-				albumAttrs.genre = "Misc";
-
-			// Use the first cover that we find
-			if (albumAttrs.cover == NULL && audioAttrs.cover != NULL)
-				albumAttrs.cover = audioAttrs.cover;
-
-			if (audioAttrs.length > 0)
-				albumAttrs.length += audioAttrs.length;
-
-			if (audioAttrs.year != 0) {
-				if (audioAttrs.year > albumAttrs.max_year)
-					albumAttrs.max_year = audioAttrs.year;
-				else if (audioAttrs.year < albumAttrs.min_year)
-					albumAttrs.min_year = audioAttrs.year;
-			}
+		if (current.length_skipped)
+			lengthSkipped = true;
+
+		audio_attrs &audioAttrs = current.attrs;
+		if (current.length_only)
+			aggregator.AddUnsampledTrack(audioAttrs.length);
+		else if (current.file_type == kAudioFile)
+			aggregator.AddTrack(audioAttrs, path.Path(), current.name);
+
+		if (audioAttrs.cover != aggregator.Cover()) {
+			delete audioAttrs.cover;
+			audioAttrs.cover = NULL;
 		}
 	}
 
-	if (numAudioFiles < 3) {
+	album_verdict verdict = aggregator.Finish(albumAttrs);
+	bool differentArtists = aggregator.DifferentArtists();
+	bool differentAlbums = aggregator.DifferentAlbums();
+
+	if (verdict == kAlbumTooFewTracks) {
 		if (gVerbose)
 			fprintf(stderr, "Directory at \"%s\" is likely not to be an album - contains less than 3 files.\n", path.Path());
 
+		rememberRejected(directory, modified, kRejectedTooFewFiles, count,
+			numSubDirectories, true);
 		return true;
 			// this is no album, but it contains music files
 	}
 
-	if (!gAllowDifferentArtists && (differentArtists || differentAlbums)) {
+	if (verdict == kAlbumMixed && !gAllowDifferentArtists) {
 		if (!gFromShell) {
 			char message[1024];
 			snprintf(message, sizeof(message),
@@ -646,7 +1559,7 @@ handleDirectory(BEntry &entry, int32 level)
 					differentArtists && differentAlbums ? "artist and album" :
 					differentArtists ? "artist" : "album");
 
-			if (albumAttrs.genre.ICompare("Soundtrack")
+			if (strcasecmp(albumAttrs.genre, "Soundtrack")
 				&& (new BAlert("Album Attributes", message,
 						"Continue", "Cancel"))->Go() != 0) {
 				return false;
@@ -655,64 +1568,334 @@ handleDirectory(BEntry &entry, int32 level)
 			fprintf(stderr,
 				"Directory at \"%s\" is not an album - Artist/Album differs from file to file.\n"
 				"Use the -d option to allow setting the album attributes\n", path.Path());
+			rememberRejected(directory, modified, kRejectedDifferentArtists,
+				count, numSubDirectories, false);
 			return false;
 		}
 
 		if (differentArtists)
-			albumAttrs.artist = "Various";
+			albumAttrs.artist = aggregator.Various();
 	}
 
 	if (gVerbose) {
-		printf("Artist = \"%s\", Album = \"%s\", genre = %s, length = %02ld:%02ld, year = %ld - %ld\n",
-			albumAttrs.artist.String(),
-			albumAttrs.album.String(),
-			albumAttrs.genre.String(),
+		// keep standard output clean when the album records are exported there
+		fprintf(export_to_stdout() ? stderr : stdout,
+			"Artist = \"%s\", Album = \"%s\", genre = %s, length = %02" B_PRId32
+				":%02" B_PRId32 ", year = %" B_PRId32 " - %" B_PRId32 "\n",
+			albumAttrs.artist,
+			albumAttrs.album,
+			albumAttrs.genre,
 			albumAttrs.length / 60,
 			albumAttrs.length % 60,
 			albumAttrs.min_year,
 			albumAttrs.max_year);
 	}
 
+	directoryTimer.SetAlbum(true);
+	if (lengthSkipped)
+		collection.incomplete = true;
+	addToCollection(collection, albumAttrs.genre, albumAttrs.length,
+		albumAttrs.min_year, albumAttrs.max_year);
+	collection.is_album = true;
+
+	entry_ref coverRef;
+	// with an icon queue, or a follow-up, the images are only looked at
+	// later
+	if (albumAttrs.cover_source == kCoverNone
+		&& ((gCreateCoverIcons && gIconQueue == NULL && gFollowUp == NULL)
+			|| export_enabled() || catalogue_enabled())
+		&& collectImages(entry, images) > 0) {
+		{
+			PhaseTimer timer(kPhaseCollectImages);
+			status = choose_cover(images, coverRef);
+		}
+		if (status == B_OK) {
+			albumAttrs.cover_source = kCoverImage;
+			if (export_enabled() || catalogue_enabled())
+				albumAttrs.cover_path = BPath(&coverRef).Path();
+		} else
+			albumAttrs.warnings |= kWarningAmbiguousCover;
+	}
+
+	if (gDryRun) {
+		export_album(path.Path(), albumAttrs);
+		catalogue_add_album(path.Path(), albumAttrs);
+		return true;
+	}
+
 	// write back album information
 
+	PhaseTimer writeTimer(kPhaseWriteAttributes);
 	BNode node(&entry);
 
+	// it might have been rejected before it was forced, or fixed
+	node.RemoveAttr(kRejectedAttribute);
+
 	if (gUseAlbumType) {
 		// write new mime type
 		node.WriteAttr("BEOS:TYPE", B_MIME_STRING_TYPE, 0, kAlbumMimeString, strlen(kAlbumMimeString) + 1);
 	}
 
-	writeAttributeString(node, "Album:Artist", albumAttrs.artist.String(), gForce);
-	writeAttributeString(node, "Album:Title", albumAttrs.album.String(), gForce);
-	writeAttributeString(node, "Album:Genre", albumAttrs.genre.String(), gForce);
+	// the follow-up of the Tracker add-on leaves what it has written alone,
+	// as the add-on might have asked about the artist
+	if (!gFollowUpRun) {
+		writeAttributeString(node, "Album:Artist", albumAttrs.artist, gForce);
+		writeAttributeString(node, "Album:Title", albumAttrs.album, gForce);
+		writeAttributeString(node, "Album:Genre", albumAttrs.genre, gForce);
+	}
 
+	// a length that is known to be short would never be replaced
 	char buffer[64];
-	sprintf(buffer, "%02ld:%02ld", albumAttrs.length / 60, albumAttrs.length % 60);
-	writeAttributeString(node, "Album:Length", buffer, gForce);
-
-	if (albumAttrs.min_year != 0 && albumAttrs.max_year != 0) {
-		if (albumAttrs.min_year == albumAttrs.max_year)
-			sprintf(buffer, "%4ld", albumAttrs.min_year);
-		else
-			sprintf(buffer, "%4ld-%4ld", albumAttrs.min_year, albumAttrs.max_year);
+	if (!lengthSkipped) {
+		formatLength(buffer, albumAttrs.length);
+		writeAttributeString(node, "Album:Length", buffer, gForce);
+	}
 
+	if (albumAttrs.min_year != 0 && albumAttrs.max_year != 0
+		&& !gFollowUpRun) {
+		formatYears(buffer, albumAttrs.min_year, albumAttrs.max_year);
 		writeAttributeString(node, "Album:Year", buffer, gForce);
 	}
 
-	if (gCreateCoverIcons) {
-		if (albumAttrs.cover != NULL) {
-			createCoverIcons(entry, albumAttrs.cover, NULL);
-		} else if (collectImages(entry, images) > 0) {
-			entry_ref cover;
-			if (chooseCover(images, cover) == B_OK)
-				createCoverIcons(entry, NULL, &cover);
+	if (gFollowUp != NULL) {
+		if (lengthSkipped || gCreateCoverIcons) {
+			BAutolock _(gFollowUpLock);
+			gFollowUp->AddString("path", path.Path());
+		}
+	} else if (gCreateCoverIcons && gIconQueue != NULL) {
+		entry_ref ref;
+		if (entry.GetRef(&ref) == B_OK) {
+			gIconQueue->Add(ref, albumAttrs.cover_source,
+				albumAttrs.cover_path.String());
 		}
+	} else if (gCreateCoverIcons) {
+		if (albumAttrs.cover_source == kCoverEmbedded)
+			createCoverIcons(entry, albumAttrs.cover, NULL);
+		else if (albumAttrs.cover_source == kCoverImage)
+			createCoverIcons(entry, NULL, &coverRef);
 	}
 
+	export_album(path.Path(), albumAttrs);
+	catalogue_add_album(path.Path(), albumAttrs);
 	return true;
 }
 
 
+/*!	Handles the directory, and adds the albums it contains (including all
+	of its sub-directories) to the \a parent collection.
+*/
+bool
+handleDirectory(BEntry &entry, int32 level, collection_attrs *parent)
+{
+	BPath path(&entry);
+	collection_attrs collection;
+
+	bool result;
+	if (journal_lookup(path.Path(), result)) {
+		if (gVerbose)
+			fprintf(stderr, "Directory at \"%s\" has already been done.\n", path.Path());
+
+		// its sub-directories won't be visited, so we use what has been
+		// written when it was done
+		if (parent != NULL) {
+			BNode node(&entry);
+			readCollection(node, collection);
+			mergeCollection(*parent, collection);
+		}
+		return result;
+	}
+
+	if (lookupRejected(entry, level, result, collection)) {
+		if (gVerbose)
+			fprintf(stderr, "Directory at \"%s\" is unchanged, and no album.\n", path.Path());
+	} else
+		result = scanDirectory(entry, path, level, collection);
+
+	if (!collection.is_album && collection.albums > 0 && !gDryRun) {
+		BNode node(&entry);
+		writeCollection(node, collection);
+	}
+
+	if (parent != NULL)
+		mergeCollection(*parent, collection);
+
+	// without all lengths, it has to be looked at again
+	if (!collection.incomplete)
+		journal_record(path.Path(), result);
+	return result;
+}
+
+
+/*!	Creates the icons of an album that has been scanned already; this is
+	called by the IconQueue, with the cover found during the scan, if any.
+*/
+void
+createDeferredIcons(const icon_job &job)
+{
+	BEntry entry(&job.directory);
+	if (entry.InitCheck() != B_OK)
+		return;
+
+	if (job.cover_source == kCoverEmbedded) {
+		BEntry song(job.cover_path.String());
+		audio_attrs audioAttrs;
+		audioAttrs.cover = NULL;
+		retrieveFromTags(song, job.cover_path.String(), NULL, audioAttrs,
+			NULL, true);
+
+		if (audioAttrs.cover != NULL) {
+			createCoverIcons(entry, audioAttrs.cover, NULL);
+			delete audioAttrs.cover;
+		}
+		return;
+	}
+
+	entry_ref coverRef;
+	if (job.cover_source == kCoverImage) {
+		BEntry image(job.cover_path.String());
+		if (image.GetRef(&coverRef) != B_OK)
+			return;
+	} else {
+		BMessage images;
+		if (collectImages(entry, images) == 0)
+			return;
+
+		PhaseTimer timer(kPhaseCollectImages);
+		if (choose_cover(images, coverRef) != B_OK)
+			return;
+	}
+
+	createCoverIcons(entry, NULL, &coverRef);
+}
+
+
+/*!	Handles one of the directories we were given, in a worker of the
+	VolumeQueue.
+*/
+void
+handleRoot(const entry_ref &ref)
+{
+	if (gPrefetchDepth > 0) {
+		gPrefetcher = new Prefetcher(gPrefetchDepth, &getFileType);
+		if (gPrefetcher->InitCheck() != B_OK) {
+			delete gPrefetcher;
+			gPrefetcher = NULL;
+		}
+	}
+
+	gArenaCache = new ArenaCache;
+
+	BEntry entry(&ref);
+	if (entry.InitCheck() == B_OK)
+		handleDirectory(entry, 0);
+
+	delete gPrefetcher;
+	gPrefetcher = NULL;
+
+	stats_count(kCounterArenaBlocks, gArenaCache->CountAllocations());
+	delete gArenaCache;
+	gArenaCache = NULL;
+}
+
+
+void
+openQuarantine()
+{
+	const char *path = gQuarantinePath;
+	char defaultPath[B_PATH_NAME_LENGTH];
+	if (path == NULL
+		&& quarantine_default_path(defaultPath, sizeof(defaultPath)) == B_OK)
+		path = defaultPath;
+
+	if (path == NULL)
+		return;
+
+	status_t status = quarantine_open(path);
+	if (status != B_OK) {
+		fprintf(stderr, "albumattr: could not open quarantine \"%s\": %s\n",
+			path, strerror(status));
+	}
+}
+
+
+/*!	Starts the workers that create the cover icons, while the scan goes on
+	with the next albums. With "--icon-jobs=0", or if they cannot be
+	started, the icons are created right away during the scan instead.
+*/
+void
+startIconQueue(int32 priority)
+{
+	if (!gCreateCoverIcons || gDryRun || gIconJobs == 0)
+		return;
+
+	int32 workers = gIconJobs;
+	if (workers < 0) {
+		system_info info;
+		get_system_info(&info);
+		workers = info.cpu_count;
+	}
+
+	gIconQueue = new IconQueue(&createDeferredIcons, workers,
+		workers * kIconJobsPerWorker, priority);
+	if (gIconQueue->InitCheck() != B_OK) {
+		delete gIconQueue;
+		gIconQueue = NULL;
+	}
+}
+
+
+/*!	Waits until all icons are done. */
+void
+stopIconQueue()
+{
+	delete gIconQueue;
+	gIconQueue = NULL;
+}
+
+
+/*!	Starts a copy of the Tracker add-on as a low priority process that
+	finishes the albums in \a followUp: it creates their icons, and asks
+	the Media Kit for the lengths the add-on had no time for. So Tracker
+	does not have to wait for either, and the add-on can be unloaded.
+*/
+void
+startFollowUp(const BMessage &followUp)
+{
+	image_info info;
+	if (followUp.IsEmpty() || own_image(info) != B_OK)
+		return;
+
+	std::vector<const char *> args;
+	args.push_back(info.name);
+	args.push_back("--follow-up");
+	if (gForce)
+		args.push_back("-f");
+	if (gCreateCoverIcons)
+		args.push_back("-c");
+	if (!gUseImageIcon)
+		args.push_back("-t");
+	if (!gUseMediaKit)
+		args.push_back("-m");
+	if (gIsolate)
+		args.push_back("--isolate");
+
+	const char *path;
+	for (int32 i = 0; followUp.FindString("path", i, &path) == B_OK; i++)
+		args.push_back(path);
+	args.push_back(NULL);
+
+	thread_id team = load_image(args.size() - 1, &args[0],
+		(const char **)environ);
+	if (team < B_OK) {
+		fprintf(stderr, "albumattr: could not start the follow-up: %s\n",
+			strerror(team));
+		return;
+	}
+
+	resume_thread(team);
+}
+
+
 //	#pragma mark -
 
 
@@ -838,6 +2021,12 @@ SettingsWindow::SettingsWindow(BRect rect)
 	fUseMediaKit->SetValue(gUseMediaKit);
 	view->AddChild(fUseMediaKit);
 
+	rect.OffsetBySelf(0, height + 8);
+	fIsolate = new BCheckBox(rect, NULL, "Run decoders in a helper process", NULL);
+	fIsolate->ResizeToPreferred();
+	fIsolate->SetValue(gIsolate);
+	view->AddChild(fIsolate);
+
 	// change the size of the window to be large enough for its contents
 	ResizeTo(fUseMediaKit->Bounds().Width() + 16, rect.bottom + 8);
 }
@@ -852,6 +2041,7 @@ SettingsWindow::~SettingsWindow()
 	gCreateCoverIcons = fCreateCoverIcons->Value() != 0;
 	gUseImageIcon = fUseImageIcon->Value() != 0;
 	gAllowDifferentArtists = fAllowDifferentArtists->Value() != 0;
+	gIsolate = fIsolate->Value() != 0;
 
 	saveSettings();
 }
@@ -915,6 +2105,17 @@ process_refs(entry_ref directoryRef, BMessage *msg, void *)
 		}
 	}
 
+	// a decoder that hangs only costs a thread; to survive crashes as
+	// well, "isolate decoders" has to be turned on in the settings
+	openQuarantine();
+
+	// Tracker shows the album columns as soon as the attributes are there,
+	// so they are written first, and the icons, and the lengths that take
+	// too long to find, are left to a process of their own
+	gFolderBudget = kTrackerFolderBudget;
+	BMessage followUp;
+	gFollowUp = &followUp;
+
 	// first, check if the MIME type is already installed
 
 	BMimeType mime(kAlbumMimeString);
@@ -922,19 +2123,27 @@ process_refs(entry_ref directoryRef, BMessage *msg, void *)
 		|| !mime.IsInstalled())
 		registerFileType();
 
+	VolumeQueue queue(gVolumeJobs, &handleRoot);
+
 	entry_ref ref;
 	int32 index;
-	for (index = 0; msg->FindRef("refs", index, &ref) == B_OK; index ++) {
-		BEntry entry(&ref);
-		if (entry.InitCheck() == B_OK)
-			handleDirectory(entry, 0);
-	}
+	for (index = 0; msg->FindRef("refs", index, &ref) == B_OK; index ++)
+		queue.Add(ref);
 
-	if (index == 0) {
-		BEntry entry(&directoryRef);
-		if (entry.InitCheck() == B_OK)
-			handleDirectory(entry, 0);
-	}
+	if (index == 0)
+		queue.Add(directoryRef);
+
+	queue.Run();
+
+	gFollowUp = NULL;
+	startFollowUp(followUp);
+
+	// we must not return while a decoder we gave up on still runs our
+	// code, as Tracker unloads us
+	watchdog_wait_for_abandoned();
+	gFolderBudget = 0;
+
+	quarantine_close();
 }
 
 
@@ -957,11 +2166,194 @@ printUsage(char *cmd)
 		"  -c\tfinds a cover image and set their thumbnail as directory icon\n"
 		"  -t\tdon't use the thumbnail from the image, always create a new one\n"
 		"  -d\tallows different artists in one album (i.e. for samplers, soundtracks, ...)\n"
-		"  -s\tread options from standard settings file\n",
+		"  -s\tread options from standard settings file\n"
+		"  --stats[=json]\tprint timing and counters of the scan phases when done\n"
+		"  --export=<file>\tstream a record per album to file (\"-\" for stdout)\n"
+		"  --export-format=ndjson|message\tJSON lines, or flattened BMessages\n"
+		"  --dry-run\tdon't write any attributes or icons\n"
+		"  --catalogue=<file>\tadd the albums found to a catalogue file\n"
+		"  --resume[=<journal>]\tskip directories done by an interrupted run\n"
+		"  --prefetch=<depth>\tnumber of files read ahead (default 4, 0 disables)\n"
+		"  --max-read=<KB/s>\tlimit the amount of data read per second\n"
+		"  --max-files=<n>\tlimit the number of files opened per second\n"
+		"  --background\trun at low priority, and back off when the disk is busy\n"
+		"  --timeout=<seconds>\tgive up on a decoder after this time (default 10)\n"
+		"  --isolate\trun the decoders on each file in a helper process\n"
+		"  --quarantine=<file>\tlist of files that made a decoder hang or crash\n"
+		"  --volume-jobs=<n>\tdirectories given scanned at once per volume (default 1)\n"
+		"  --icon-jobs=<n>\tthreads creating icons (default one per CPU, 0 inline)\n"
+		"  --sample=<n>\tonly check n files closely in folders of more than 2n\n",
 		name);
 }
 
 
+/*!	Runs a decoder on \a path for the \a kind of probe of the parent
+	process that started us with "--probe", and writes its result to
+	\c gProbeOutput: the length as text, or the cover as an archived
+	bitmap; see sandbox_run(). If the decoder crashes or hangs, the parent
+	will put the file in quarantine, so a file we cannot even open has to
+	be reported differently, by a non-zero exit status.
+*/
+int
+runProbe(const char *kind, const char *path)
+{
+	gDecoderTimeout = 0;
+	gIsolate = false;
+
+	// don't keep the pipes of other helpers open
+	for (int fd = STDERR_FILENO + 1; fd < getdtablesize(); fd++) {
+		if (fd != gProbeOutput)
+			close(fd);
+	}
+
+	BEntry entry(path);
+	entry_ref ref;
+	if (entry.GetRef(&ref) != B_OK)
+		return 1;
+
+	BMallocIO output;
+
+	if (!strcmp(kind, "length")) {
+		char length[32];
+		snprintf(length, sizeof(length), "%" B_PRId32 "\n",
+			lengthFromMediaKit(ref));
+		output.Write(length, strlen(length));
+	} else if (!strcmp(kind, "cover")) {
+		BBitmap *bitmap = NULL;
+		if (getFileType(entry) == kAudioFile) {
+			audio_attrs audioAttrs;
+			audioAttrs.cover = NULL;
+			retrieveFromTags(entry, path, NULL, audioAttrs, NULL, true);
+			bitmap = audioAttrs.cover;
+		} else
+			bitmap = BTranslationUtils::GetBitmap(&ref);
+
+		BMessage archive;
+		if (bitmap != NULL && bitmap->Archive(&archive) == B_OK)
+			archive.Flatten(&output);
+
+		delete bitmap;
+	} else
+		return 1;
+
+	const uint8 *buffer = (const uint8 *)output.Buffer();
+	size_t left = output.BufferLength();
+	while (left > 0) {
+		ssize_t bytesWritten = write(gProbeOutput, buffer, left);
+		if (bytesWritten < 0 && errno == EINTR)
+			continue;
+		if (bytesWritten <= 0)
+			return 1;
+
+		buffer += bytesWritten;
+		left -= bytesWritten;
+	}
+
+	return 0;
+}
+
+
+bool
+parseLongOption(const char *option)
+{
+	if (!strncmp(option, "export=", 7) && option[7]) {
+		gExportPath = option + 7;
+		return true;
+	}
+	if (!strcmp(option, "export-format=ndjson")) {
+		gExportFormat = kExportNDJSON;
+		return true;
+	}
+	if (!strcmp(option, "export-format=message")) {
+		gExportFormat = kExportMessage;
+		return true;
+	}
+	if (!strncmp(option, "catalogue=", 10) && option[10]) {
+		gCataloguePath = option + 10;
+		return true;
+	}
+	if (!strcmp(option, "resume")) {
+		gResume = true;
+		return true;
+	}
+	if (!strncmp(option, "resume=", 7) && option[7]) {
+		gResume = true;
+		gJournalPath = option + 7;
+		return true;
+	}
+	if (!strncmp(option, "prefetch=", 9) && isdigit(option[9])) {
+		gPrefetchDepth = atol(option + 9);
+		return true;
+	}
+	if (!strncmp(option, "max-read=", 9) && isdigit(option[9])) {
+		gMaxReadRate = atoll(option + 9) * 1024;
+		return true;
+	}
+	if (!strncmp(option, "max-files=", 10) && isdigit(option[10])) {
+		gMaxFileRate = atol(option + 10);
+		return true;
+	}
+	if (!strcmp(option, "background")) {
+		gBackground = true;
+		return true;
+	}
+	if (!strncmp(option, "timeout=", 8) && isdigit(option[8])) {
+		gDecoderTimeout = atol(option + 8) * 1000000LL;
+		return true;
+	}
+	if (!strcmp(option, "follow-up")) {
+		// the Tracker add-on has accepted these folders as albums already
+		gFollowUpRun = true;
+		gBackground = true;
+		gAllowDifferentArtists = true;
+		return true;
+	}
+	if (!strcmp(option, "isolate")) {
+		gIsolate = true;
+		return true;
+	}
+	if (!strncmp(option, "quarantine=", 11) && option[11]) {
+		gQuarantinePath = option + 11;
+		return true;
+	}
+	if (!strncmp(option, "probe=", 6) && option[6]) {
+		gProbe = option + 6;
+		return true;
+	}
+	if (!strncmp(option, "probe-output=", 13) && isdigit(option[13])) {
+		gProbeOutput = atoi(option + 13);
+		return true;
+	}
+	if (!strncmp(option, "volume-jobs=", 12) && isdigit(option[12])) {
+		gVolumeJobs = atol(option + 12);
+		return true;
+	}
+	if (!strncmp(option, "icon-jobs=", 10) && isdigit(option[10])) {
+		gIconJobs = atol(option + 10);
+		return true;
+	}
+	if (!strncmp(option, "sample=", 7) && isdigit(option[7])) {
+		gSampleSize = atol(option + 7);
+		return true;
+	}
+	if (!strcmp(option, "dry-run")) {
+		gDryRun = true;
+		return true;
+	}
+
+	if (!strcmp(option, "stats") || !strcmp(option, "stats=table")) {
+		gStats = kStatsTable;
+		return true;
+	}
+	if (!strcmp(option, "stats=json")) {
+		gStats = kStatsJSON;
+		return true;
+	}
+
+	return false;
+}
+
+
 int
 main(int argc, char **argv)
 {
@@ -978,6 +2370,14 @@ main(int argc, char **argv)
 	gFromShell = true;
 
 	while (*++argv && **argv == '-') {
+		if ((*argv)[1] == '-') {
+			if (!parseLongOption(*argv + 2)) {
+				printUsage(cmd);
+				return 1;
+			}
+			continue;
+		}
+
 		for (int i = 1; (*argv)[i]; i++) {
 			switch ((*argv)[i]) {
 				case 'v':
@@ -1014,18 +2414,89 @@ main(int argc, char **argv)
 		}
 	}
 
-	if (registerType)
+	if (gProbe != NULL)
+		return *argv != NULL ? runProbe(gProbe, *argv) : 1;
+
+	if (gExportPath != NULL) {
+		status_t status = export_open(gExportPath, gExportFormat);
+		if (status != B_OK) {
+			fprintf(stderr, "albumattr: could not open \"%s\": %s\n",
+				gExportPath, strerror(status));
+			return 1;
+		}
+	}
+
+	if (registerType && !gDryRun)
 		registerFileType();
 
+	// in background mode, we try not to get in the way of anyone else
+	// using the same volume
+
+	if (gBackground) {
+		if (gMaxReadRate == 0)
+			gMaxReadRate = kBackgroundReadRate;
+		if (gMaxFileRate == 0)
+			gMaxFileRate = kBackgroundFileRate;
+	}
+
+	throttle_init(gMaxReadRate, gMaxFileRate, gBackground);
+	openQuarantine();
+	startIconQueue(gBackground ? B_LOW_PRIORITY : B_NORMAL_PRIORITY);
+
+	// recursive runs may take hours, so they keep a journal of the
+	// directories they are done with, to be able to resume them; a dry
+	// run has done nothing a later run could skip, and writes no journal
+
+	char journalPath[B_PATH_NAME_LENGTH];
+	if ((gRecursive || gResume) && !gDryRun && gJournalPath == NULL
+		&& journal_default_path(journalPath, sizeof(journalPath)) == B_OK)
+		gJournalPath = journalPath;
+
+	if (gJournalPath != NULL && (gRecursive || gResume) && !gDryRun) {
+		status_t status = journal_open(gJournalPath, gResume);
+		if (status != B_OK) {
+			fprintf(stderr, "albumattr: could not open journal \"%s\": %s\n",
+				gJournalPath, strerror(status));
+		}
+	}
+
+	// the catalogue keeps a log of its own, for the directories that a
+	// resumed run will skip
+	if (gCataloguePath != NULL) {
+		status_t status = catalogue_open(gCataloguePath, gResume);
+		if (status != B_OK) {
+			fprintf(stderr, "albumattr: could not open catalogue log for "
+				"\"%s\": %s\n", gCataloguePath, strerror(status));
+		}
+	}
+
 	argv--;
 
+	VolumeQueue queue(gVolumeJobs, &handleRoot);
+
 	while (*++argv) {
 		BEntry entry(*argv);
+		entry_ref ref;
 
-		if (entry.InitCheck() == B_OK)
-			handleDirectory(entry, 0);
+		if (entry.InitCheck() == B_OK && entry.GetRef(&ref) == B_OK)
+			queue.Add(ref);
 		else
 			fprintf(stderr, "could not find \"%s\".\n", *argv);
 	}
-	return 0;
+
+	queue.Run();
+	stopIconQueue();
+
+	export_close();
+	journal_close(true);
+	quarantine_close();
+
+	status_t status = catalogue_close();
+	if (status != B_OK) {
+		fprintf(stderr, "albumattr: could not write the catalogue: %s\n",
+			strerror(status));
+	}
+
+	stats_print(stderr);
+	return status == B_OK ? 0 : 1;
 }
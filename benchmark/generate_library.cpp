@@ -0,0 +1,757 @@
+/* generate_library - creates a reproducible synthetic music library
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ *
+ * The library consists of artist folders containing albums of tagged MP3
+ * and FLAC stubs, with embedded and loose covers of various sizes,
+ * samplers, multi-disc albums, and a few folders that are no albums at
+ * all. The stubs only contain valid tags and a bit of payload, no audio.
+ *
+ * On Haiku, the Audio:* and Media:* attributes are written as real file
+ * system attributes. Elsewhere, they are stored as extended attributes
+ * named "user.haiku.<attribute>", whose value is the big endian type code
+ * followed by the attribute data; that is enough to run the generator,
+ * and to inspect the result on a plain Linux box.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __HAIKU__
+#	include <fs_attr.h>
+#else
+#	include <sys/xattr.h>
+#endif
+
+
+static const uint32_t kStringType = 'CSTR';
+static const uint32_t kMimeStringType = 'MIMS';
+static const uint32_t kInt32Type = 'LONG';
+
+static const char* kGenres[] = {"Rock", "Jazz", "Classical", "Pop",
+	"Electronic", "Soundtrack", "Folk", "Metal"};
+static const int32_t kGenreCount = sizeof(kGenres) / sizeof(kGenres[0]);
+
+static const int32_t kCoverSizes[] = {64, 128, 300, 500};
+static const int32_t kCoverSizeCount
+	= sizeof(kCoverSizes) / sizeof(kCoverSizes[0]);
+
+enum album_kind {
+	kRegularAlbum,
+	kFLACAlbum,
+	kSampler,
+	kMultiDisc,
+	kLooseTracks
+};
+
+enum cover_kind {
+	kNoCover,
+	kEmbeddedCover,
+	kLooseCover
+};
+
+struct generator_options {
+	const char*	root;
+	int32_t		albums;
+	int32_t		albumsPerArtist;
+	int32_t		minTracks;
+	int32_t		maxTracks;
+	int32_t		payloadSize;
+	int32_t		noLengthPercent;
+	uint32_t	seed;
+};
+
+struct generator_stats {
+	int32_t		albums;
+	int32_t		tracks;
+	int32_t		covers;
+	int64_t		bytes;
+};
+
+struct byte_buffer {
+	uint8_t*	data;
+	size_t		size;
+	size_t		capacity;
+};
+
+
+static uint32_t sRandomState;
+
+
+static uint32_t
+random_next()
+{
+	// xorshift32 - the same seed always produces the same library
+	uint32_t x = sRandomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return sRandomState = x;
+}
+
+
+static int32_t
+random_range(int32_t min, int32_t max)
+{
+	return min + (int32_t)(random_next() % (uint32_t)(max - min + 1));
+}
+
+
+//	#pragma mark - buffers
+
+
+static void
+buffer_append(byte_buffer& buffer, const void* data, size_t size)
+{
+	if (buffer.size + size > buffer.capacity) {
+		size_t capacity = buffer.capacity > 0 ? buffer.capacity * 2 : 4096;
+		while (capacity < buffer.size + size)
+			capacity *= 2;
+
+		uint8_t* newData = (uint8_t*)realloc(buffer.data, capacity);
+		if (newData == NULL) {
+			fprintf(stderr, "generate_library: out of memory\n");
+			exit(1);
+		}
+
+		buffer.data = newData;
+		buffer.capacity = capacity;
+	}
+
+	memcpy(buffer.data + buffer.size, data, size);
+	buffer.size += size;
+}
+
+
+static void
+buffer_append_byte(byte_buffer& buffer, uint8_t value)
+{
+	buffer_append(buffer, &value, 1);
+}
+
+
+static void
+buffer_append_big32(byte_buffer& buffer, uint32_t value)
+{
+	uint8_t bytes[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16),
+		(uint8_t)(value >> 8), (uint8_t)value};
+	buffer_append(buffer, bytes, 4);
+}
+
+
+static void
+buffer_append_little32(byte_buffer& buffer, uint32_t value)
+{
+	uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value >> 8),
+		(uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+	buffer_append(buffer, bytes, 4);
+}
+
+
+static void
+buffer_append_string(byte_buffer& buffer, const char* string)
+{
+	buffer_append(buffer, string, strlen(string));
+}
+
+
+static void
+buffer_free(byte_buffer& buffer)
+{
+	free(buffer.data);
+	buffer.data = NULL;
+	buffer.size = buffer.capacity = 0;
+}
+
+
+//	#pragma mark - attributes and files
+
+
+static void
+write_attribute(const char* path, const char* name, uint32_t type,
+	const void* data, size_t size)
+{
+#ifdef __HAIKU__
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fs_write_attr(fd, name, type, 0, data, size) < 0)
+		fprintf(stderr, "could not write %s to %s: %s\n", name, path,
+			strerror(errno));
+	close(fd);
+#else
+	char attribute[512];
+	snprintf(attribute, sizeof(attribute), "user.haiku.%s", name);
+
+	byte_buffer value = {NULL, 0, 0};
+	buffer_append_big32(value, type);
+	buffer_append(value, data, size);
+
+	if (setxattr(path, attribute, value.data, value.size, 0) != 0) {
+		fprintf(stderr, "could not write %s to %s: %s\n", name, path,
+			strerror(errno));
+	}
+	buffer_free(value);
+#endif
+}
+
+
+static void
+write_string_attribute(const char* path, const char* name, const char* value,
+	uint32_t type = kStringType)
+{
+	write_attribute(path, name, type, value, strlen(value) + 1);
+}
+
+
+static void
+write_int32_attribute(const char* path, const char* name, int32_t value)
+{
+	write_attribute(path, name, kInt32Type, &value, sizeof(value));
+}
+
+
+static bool
+write_file(const char* path, const byte_buffer& buffer, generator_stats& stats)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "could not create \"%s\": %s\n", path,
+			strerror(errno));
+		return false;
+	}
+
+	bool success = fwrite(buffer.data, 1, buffer.size, file) == buffer.size;
+	if (fclose(file) != 0)
+		success = false;
+
+	if (!success)
+		fprintf(stderr, "could not write \"%s\"\n", path);
+
+	stats.bytes += buffer.size;
+	return success;
+}
+
+
+static bool
+make_directory(const char* path)
+{
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "could not create directory \"%s\": %s\n", path,
+			strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+
+/*!	Creates the directory \a name in \a parent, and returns its path in
+	\a path. Fails if the path does not fit.
+*/
+static bool
+make_directory(char* path, size_t size, const char* parent, const char* name)
+{
+	if ((size_t)snprintf(path, size, "%s/%s", parent, name) >= size) {
+		fprintf(stderr, "path too long: \"%s/%s\"\n", parent, name);
+		return false;
+	}
+
+	return make_directory(path);
+}
+
+
+//	#pragma mark - content
+
+
+/*!	Creates an uncompressed 24 bit BMP image of the given size, showing
+	a simple gradient seeded from the album number.
+*/
+static void
+create_image(byte_buffer& buffer, int32_t size, uint32_t seed)
+{
+	uint32_t rowSize = (size * 3 + 3) & ~3;
+	uint32_t imageSize = rowSize * size;
+
+	buffer_append_string(buffer, "BM");
+	uint8_t header[52];
+	memset(header, 0, sizeof(header));
+
+	// little endian header fields
+	uint32_t fields[] = {54 + imageSize, 0, 54, 40, (uint32_t)size,
+		(uint32_t)size};
+	for (uint32_t i = 0; i < 6; i++) {
+		for (int32_t shift = 0; shift < 4; shift++)
+			header[i * 4 + shift] = (uint8_t)(fields[i] >> (shift * 8));
+	}
+	header[24] = 1;
+	header[26] = 24;
+	header[32] = (uint8_t)imageSize;
+	header[33] = (uint8_t)(imageSize >> 8);
+	header[34] = (uint8_t)(imageSize >> 16);
+	header[35] = (uint8_t)(imageSize >> 24);
+	buffer_append(buffer, header, sizeof(header));
+
+	uint8_t* row = (uint8_t*)calloc(1, rowSize);
+	for (int32_t y = 0; y < size; y++) {
+		for (int32_t x = 0; x < size; x++) {
+			row[x * 3 + 0] = (uint8_t)(seed + x * 255 / size);
+			row[x * 3 + 1] = (uint8_t)(seed * 7 + y * 255 / size);
+			row[x * 3 + 2] = (uint8_t)(seed * 13 + (x + y) * 127 / size);
+		}
+		buffer_append(buffer, row, rowSize);
+	}
+	free(row);
+}
+
+
+static void
+append_payload(byte_buffer& buffer, int32_t size)
+{
+	// an MPEG-1 layer III frame header, followed by noise
+	static const uint8_t kFrameHeader[] = {0xff, 0xfb, 0x90, 0x64};
+	buffer_append(buffer, kFrameHeader, sizeof(kFrameHeader));
+
+	for (int32_t i = 4; i < size; i += 4)
+		buffer_append_big32(buffer, random_next());
+}
+
+
+static void
+append_id3_frame(byte_buffer& buffer, const char* id, const byte_buffer& data)
+{
+	buffer_append_string(buffer, id);
+	buffer_append_big32(buffer, data.size);
+	buffer_append_byte(buffer, 0);
+	buffer_append_byte(buffer, 0);
+	buffer_append(buffer, data.data, data.size);
+}
+
+
+static void
+append_id3_text_frame(byte_buffer& buffer, const char* id, const char* text)
+{
+	byte_buffer data = {NULL, 0, 0};
+	buffer_append_byte(data, 0);
+		// ISO-8859-1
+	buffer_append_string(data, text);
+
+	append_id3_frame(buffer, id, data);
+	buffer_free(data);
+}
+
+
+static void
+create_mp3(byte_buffer& buffer, const char* artist, const char* album,
+	const char* title, const char* genre, int32_t year,
+	const byte_buffer* cover, int32_t payloadSize)
+{
+	byte_buffer frames = {NULL, 0, 0};
+	char yearString[16];
+	snprintf(yearString, sizeof(yearString), "%d", (int)year);
+
+	append_id3_text_frame(frames, "TPE1", artist);
+	append_id3_text_frame(frames, "TALB", album);
+	append_id3_text_frame(frames, "TIT2", title);
+	append_id3_text_frame(frames, "TCON", genre);
+	append_id3_text_frame(frames, "TYER", yearString);
+
+	if (cover != NULL) {
+		byte_buffer picture = {NULL, 0, 0};
+		buffer_append_byte(picture, 0);
+		buffer_append(picture, "image/bmp", 10);
+		buffer_append_byte(picture, 3);
+			// front cover
+		buffer_append_byte(picture, 0);
+			// empty description
+		buffer_append(picture, cover->data, cover->size);
+
+		append_id3_frame(frames, "APIC", picture);
+		buffer_free(picture);
+	}
+
+	// ID3v2.3 header, the size is stored as a sync-safe integer
+	uint32_t size = frames.size;
+	uint8_t header[10] = {'I', 'D', '3', 3, 0, 0,
+		(uint8_t)((size >> 21) & 0x7f), (uint8_t)((size >> 14) & 0x7f),
+		(uint8_t)((size >> 7) & 0x7f), (uint8_t)(size & 0x7f)};
+
+	buffer_append(buffer, header, sizeof(header));
+	buffer_append(buffer, frames.data, frames.size);
+	buffer_free(frames);
+
+	append_payload(buffer, payloadSize);
+}
+
+
+static void
+append_flac_block(byte_buffer& buffer, uint8_t type, bool last,
+	const byte_buffer& data)
+{
+	buffer_append_byte(buffer, (last ? 0x80 : 0) | type);
+	buffer_append_byte(buffer, (uint8_t)(data.size >> 16));
+	buffer_append_byte(buffer, (uint8_t)(data.size >> 8));
+	buffer_append_byte(buffer, (uint8_t)data.size);
+	buffer_append(buffer, data.data, data.size);
+}
+
+
+static void
+append_vorbis_comment(byte_buffer& buffer, const char* name,
+	const char* value)
+{
+	buffer_append_little32(buffer, strlen(name) + 1 + strlen(value));
+	buffer_append_string(buffer, name);
+	buffer_append_byte(buffer, '=');
+	buffer_append_string(buffer, value);
+}
+
+
+static void
+create_flac(byte_buffer& buffer, const char* artist, const char* album,
+	const char* title, const char* genre, int32_t year, int32_t length,
+	const byte_buffer* cover, int32_t coverSize, int32_t payloadSize)
+{
+	buffer_append_string(buffer, "fLaC");
+
+	// STREAMINFO: 4096 samples per block, 44.1 kHz, stereo, 16 bit
+	byte_buffer info = {NULL, 0, 0};
+	uint64_t samples = (uint64_t)length * 44100;
+	uint64_t packed = ((uint64_t)44100 << 44) | ((uint64_t)1 << 41)
+		| ((uint64_t)15 << 36) | (samples & 0xfffffffffULL);
+	buffer_append_big32(info, (4096 << 16) | 4096);
+	for (int32_t i = 0; i < 6; i++)
+		buffer_append_byte(info, 0);
+			// unknown frame sizes
+	buffer_append_big32(info, (uint32_t)(packed >> 32));
+	buffer_append_big32(info, (uint32_t)packed);
+	for (int32_t i = 0; i < 16; i++)
+		buffer_append_byte(info, 0);
+			// no MD5 signature
+
+	byte_buffer comments = {NULL, 0, 0};
+	char yearString[16];
+	snprintf(yearString, sizeof(yearString), "%d", (int)year);
+	static const char* kVendor = "albumattr generate_library";
+	buffer_append_little32(comments, strlen(kVendor));
+	buffer_append_string(comments, kVendor);
+	buffer_append_little32(comments, 5);
+	append_vorbis_comment(comments, "ARTIST", artist);
+	append_vorbis_comment(comments, "ALBUM", album);
+	append_vorbis_comment(comments, "TITLE", title);
+	append_vorbis_comment(comments, "GENRE", genre);
+	append_vorbis_comment(comments, "DATE", yearString);
+
+	append_flac_block(buffer, 0, false, info);
+	append_flac_block(buffer, 4, cover == NULL, comments);
+
+	if (cover != NULL) {
+		byte_buffer picture = {NULL, 0, 0};
+		buffer_append_big32(picture, 3);
+			// front cover
+		buffer_append_big32(picture, 9);
+		buffer_append_string(picture, "image/bmp");
+		buffer_append_big32(picture, 0);
+		buffer_append_big32(picture, coverSize);
+		buffer_append_big32(picture, coverSize);
+		buffer_append_big32(picture, 24);
+		buffer_append_big32(picture, 0);
+		buffer_append_big32(picture, cover->size);
+		buffer_append(picture, cover->data, cover->size);
+
+		append_flac_block(buffer, 6, true, picture);
+		buffer_free(picture);
+	}
+
+	buffer_free(info);
+	buffer_free(comments);
+
+	// a frame sync code, followed by noise
+	buffer_append_byte(buffer, 0xff);
+	buffer_append_byte(buffer, 0xf8);
+	for (int32_t i = 2; i < payloadSize; i += 4)
+		buffer_append_big32(buffer, random_next());
+}
+
+
+//	#pragma mark - library
+
+
+static void
+create_track(const char* directory, int32_t number, bool flac,
+	const char* artist, const char* album, const char* genre, int32_t year,
+	const byte_buffer* cover, int32_t coverSize,
+	const generator_options& options, generator_stats& stats)
+{
+	char title[64];
+	snprintf(title, sizeof(title), "Track %d", (int)number);
+
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/%02d - %s.%s", directory, (int)number,
+		title, flac ? "flac" : "mp3");
+
+	int32_t length = random_range(90, 420);
+
+	byte_buffer buffer = {NULL, 0, 0};
+	if (flac) {
+		create_flac(buffer, artist, album, title, genre, year, length, cover,
+			coverSize, options.payloadSize);
+	} else {
+		create_mp3(buffer, artist, album, title, genre, year, cover,
+			options.payloadSize);
+	}
+
+	bool written = write_file(path, buffer, stats);
+	buffer_free(buffer);
+	if (!written)
+		return;
+
+	stats.tracks++;
+
+	write_string_attribute(path, "BEOS:TYPE", flac ? "audio/flac" : "audio/mpeg",
+		kMimeStringType);
+	write_string_attribute(path, "Audio:Artist", artist);
+	write_string_attribute(path, "Audio:Album", album);
+	write_string_attribute(path, "Audio:Title", title);
+	write_string_attribute(path, "Media:Genre", genre);
+	write_int32_attribute(path, "Media:Year", year);
+	write_int32_attribute(path, "Audio:Track", number);
+
+	if (random_range(1, 100) > options.noLengthPercent) {
+		char lengthString[16];
+		snprintf(lengthString, sizeof(lengthString), "%d:%02d",
+			(int)(length / 60), (int)(length % 60));
+		write_string_attribute(path, "Media:Length", lengthString);
+	}
+}
+
+
+static void
+create_loose_image(const char* directory, const char* name, int32_t size,
+	uint32_t seed, generator_stats& stats)
+{
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/%s", directory, name);
+
+	byte_buffer buffer = {NULL, 0, 0};
+	create_image(buffer, size, seed);
+	if (write_file(path, buffer, stats)) {
+		write_string_attribute(path, "BEOS:TYPE", "image/bmp",
+			kMimeStringType);
+		stats.covers++;
+	}
+	buffer_free(buffer);
+}
+
+
+static void
+create_album(const char* artistDirectory, int32_t artistNumber,
+	int32_t albumNumber, const generator_options& options,
+	generator_stats& stats)
+{
+	int32_t kindValue = random_range(1, 100);
+	album_kind kind = kindValue <= 65 ? kRegularAlbum
+		: kindValue <= 80 ? kFLACAlbum
+		: kindValue <= 88 ? kSampler
+		: kindValue <= 95 ? kMultiDisc : kLooseTracks;
+
+	int32_t coverValue = random_range(1, 100);
+	cover_kind coverKind = coverValue <= 40 ? kEmbeddedCover
+		: coverValue <= 80 ? kLooseCover : kNoCover;
+
+	char artist[64];
+	snprintf(artist, sizeof(artist), "Artist %03d", (int)artistNumber);
+	char album[64];
+	snprintf(album, sizeof(album), "Album %05d", (int)albumNumber);
+	const char* genre = kGenres[random_range(0, kGenreCount - 1)];
+	int32_t year = random_range(1960, 2018);
+
+	// every batch of loose tracks gets a folder of its own, or else they
+	// would add up to folders that albumattr accepts as albums
+	char looseName[64];
+	snprintf(looseName, sizeof(looseName), "Downloads %05d",
+		(int)albumNumber);
+
+	char directory[1024];
+	if (!make_directory(directory, sizeof(directory), artistDirectory,
+			kind == kLooseTracks ? looseName : album))
+		return;
+
+	int32_t coverSize = kCoverSizes[random_range(0, kCoverSizeCount - 1)];
+	byte_buffer cover = {NULL, 0, 0};
+	if (coverKind == kEmbeddedCover) {
+		// keep embedded covers reasonably small, as they are in every track
+		if (coverSize > 300)
+			coverSize = 300;
+		create_image(cover, coverSize, albumNumber);
+	} else if (coverKind == kLooseCover && kind != kLooseTracks) {
+		create_loose_image(directory, "cover.bmp", coverSize, albumNumber,
+			stats);
+		if (random_range(0, 2) == 0) {
+			create_loose_image(directory, "back.bmp", coverSize,
+				albumNumber + 1, stats);
+		}
+	}
+
+	const byte_buffer* trackCover
+		= coverKind == kEmbeddedCover ? &cover : NULL;
+	int32_t tracks = random_range(options.minTracks, options.maxTracks);
+
+	switch (kind) {
+		case kRegularAlbum:
+		case kFLACAlbum:
+			for (int32_t i = 1; i <= tracks; i++) {
+				create_track(directory, i, kind == kFLACAlbum, artist, album,
+					genre, year, trackCover, coverSize, options, stats);
+			}
+			break;
+
+		case kSampler:
+			for (int32_t i = 1; i <= tracks; i++) {
+				char trackArtist[64];
+				snprintf(trackArtist, sizeof(trackArtist), "Artist %03d",
+					(int)random_range(0, 999));
+				create_track(directory, i, false, trackArtist, album, genre,
+					year, trackCover, coverSize, options, stats);
+			}
+			break;
+
+		case kMultiDisc:
+			for (int32_t disc = 1; disc <= 2; disc++) {
+				char discName[16];
+				snprintf(discName, sizeof(discName), "CD %d", (int)disc);
+				char discDirectory[1024];
+				if (!make_directory(discDirectory, sizeof(discDirectory),
+						directory, discName))
+					break;
+
+				for (int32_t i = 1; i <= tracks; i++) {
+					create_track(discDirectory, i, false, artist, album,
+						genre, year, trackCover, coverSize, options, stats);
+				}
+			}
+			break;
+
+		case kLooseTracks:
+			// not an album: just one or two unrelated tracks
+		{
+			int32_t count = random_range(1, 2);
+			for (int32_t i = 1; i <= count; i++) {
+				create_track(directory, albumNumber * 10 + i, false, artist,
+					"Singles", genre, year, NULL, 0, options, stats);
+			}
+			break;
+		}
+	}
+
+	// albumattr sees every disc of a multi-disc album as an album
+	if (kind == kMultiDisc)
+		stats.albums += 2;
+	else if (kind != kLooseTracks)
+		stats.albums++;
+
+	buffer_free(cover);
+}
+
+
+static void
+print_usage()
+{
+	fprintf(stderr,
+		"Usage: generate_library [options] <target directory>\n"
+		"  -a <count>\tnumber of album folders (default 1000)\n"
+		"  -A <count>\talbums per artist folder (default 8)\n"
+		"  -t <min>-<max>\ttracks per album (default 8-16)\n"
+		"  -p <bytes>\taudio payload per track (default 16384)\n"
+		"  -l <percent>\ttracks without Media:Length attribute (default 5)\n"
+		"  -s <seed>\trandom seed (default 1)\n");
+}
+
+
+int
+main(int argc, char** argv)
+{
+	generator_options options;
+	options.root = NULL;
+	options.albums = 1000;
+	options.albumsPerArtist = 8;
+	options.minTracks = 8;
+	options.maxTracks = 16;
+	options.payloadSize = 16384;
+	options.noLengthPercent = 5;
+	options.seed = 1;
+
+	int option;
+	while ((option = getopt(argc, argv, "a:A:t:p:l:s:")) != -1) {
+		switch (option) {
+			case 'a':
+				options.albums = atol(optarg);
+				break;
+			case 'A':
+				options.albumsPerArtist = atol(optarg);
+				break;
+			case 't':
+			{
+				options.minTracks = atol(optarg);
+				const char* max = strchr(optarg, '-');
+				options.maxTracks = max != NULL ? atol(max + 1)
+					: options.minTracks;
+				break;
+			}
+			case 'p':
+				options.payloadSize = atol(optarg);
+				break;
+			case 'l':
+				options.noLengthPercent = atol(optarg);
+				break;
+			case 's':
+				options.seed = strtoul(optarg, NULL, 0);
+				break;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1 || options.albums <= 0
+		|| options.albumsPerArtist <= 0 || options.minTracks <= 0
+		|| options.maxTracks < options.minTracks || options.payloadSize < 4) {
+		print_usage();
+		return 1;
+	}
+
+	options.root = argv[optind];
+	sRandomState = options.seed != 0 ? options.seed : 1;
+
+	if (!make_directory(options.root))
+		return 1;
+
+	generator_stats stats = {0, 0, 0, 0};
+
+	for (int32_t i = 0; i < options.albums; i++) {
+		int32_t artistNumber = i / options.albumsPerArtist;
+
+		char artistName[64];
+		snprintf(artistName, sizeof(artistName), "Artist %03d",
+			(int)artistNumber);
+		char artistDirectory[1024];
+		if (!make_directory(artistDirectory, sizeof(artistDirectory),
+				options.root, artistName))
+			return 1;
+
+		create_album(artistDirectory, artistNumber, i, options, stats);
+	}
+
+	printf("%d albums, %d tracks, %d loose images, %lld bytes in \"%s\"\n",
+		(int)stats.albums, (int)stats.tracks, (int)stats.covers,
+		(long long)stats.bytes, options.root);
+	return 0;
+}
@@ -0,0 +1,22 @@
+/* ByteOrder - the byte order macros of Haiku's Support Kit, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _BYTE_ORDER_H
+#define _BYTE_ORDER_H
+
+
+#include <SupportDefs.h>
+
+#include <endian.h>
+
+
+#define B_BENDIAN_TO_HOST_INT16(value)	be16toh(value)
+#define B_BENDIAN_TO_HOST_INT32(value)	be32toh(value)
+#define B_BENDIAN_TO_HOST_INT64(value)	be64toh(value)
+#define B_LENDIAN_TO_HOST_INT16(value)	le16toh(value)
+#define B_LENDIAN_TO_HOST_INT32(value)	le32toh(value)
+#define B_LENDIAN_TO_HOST_INT64(value)	le64toh(value)
+#define B_HOST_TO_BENDIAN_INT32(value)	htobe32(value)
+
+#endif	// _BYTE_ORDER_H
@@ -0,0 +1,58 @@
+/* DataIO - the I/O classes of Haiku's Support Kit, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _DATA_IO_H
+#define _DATA_IO_H
+
+
+#include <SupportDefs.h>
+
+
+class BDataIO {
+	public:
+		virtual ~BDataIO();
+
+		virtual ssize_t Read(void* buffer, size_t size) = 0;
+		virtual ssize_t Write(const void* buffer, size_t size) = 0;
+};
+
+
+class BPositionIO : public BDataIO {
+	public:
+		virtual ssize_t Read(void* buffer, size_t size);
+		virtual ssize_t Write(const void* buffer, size_t size);
+
+		virtual ssize_t ReadAt(off_t position, void* buffer, size_t size) = 0;
+		virtual ssize_t WriteAt(off_t position, const void* buffer,
+							size_t size) = 0;
+
+		virtual off_t Seek(off_t position, uint32 seekMode) = 0;
+		virtual off_t Position() const = 0;
+
+		virtual status_t SetSize(off_t size);
+		virtual status_t GetSize(off_t* _size) const;
+};
+
+
+/*!	Only reading is supported. */
+class BMemoryIO : public BPositionIO {
+	public:
+		BMemoryIO(const void* buffer, size_t size);
+
+		virtual ssize_t ReadAt(off_t position, void* buffer, size_t size);
+		virtual ssize_t WriteAt(off_t position, const void* buffer,
+							size_t size);
+
+		virtual off_t Seek(off_t position, uint32 seekMode);
+		virtual off_t Position() const { return fPosition; }
+
+		virtual status_t GetSize(off_t* _size) const;
+
+	private:
+		const uint8*	fBuffer;
+		size_t			fSize;
+		off_t			fPosition;
+};
+
+#endif	// _DATA_IO_H
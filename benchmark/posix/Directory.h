@@ -0,0 +1,35 @@
+/* Directory - Haiku's BDirectory, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _DIRECTORY_H
+#define _DIRECTORY_H
+
+
+#include <Node.h>
+
+#include <dirent.h>
+
+
+class BDirectory : public BNode {
+	public:
+		BDirectory(const char* path);
+		BDirectory(const BEntry* entry);
+		virtual ~BDirectory();
+
+		status_t GetNextEntry(BEntry* entry, bool traverse = false);
+		status_t Rewind();
+		int32 CountEntries();
+
+		const char* Path() const { return fPath.c_str(); }
+
+	private:
+		BDirectory(const BDirectory&);
+		BDirectory& operator=(const BDirectory&);
+
+		void _Open();
+
+		DIR*		fDirectory;
+};
+
+#endif	// _DIRECTORY_H
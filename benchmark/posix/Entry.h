@@ -0,0 +1,47 @@
+/* Entry - Haiku's BEntry and entry_ref, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _ENTRY_H
+#define _ENTRY_H
+
+
+#include <SupportDefs.h>
+
+#include <string>
+
+
+class BDirectory;
+class BPath;
+
+
+// refers to the entry by its path, there are no node numbers to use
+struct entry_ref {
+	std::string	path;
+};
+
+
+class BEntry {
+	public:
+		BEntry() : fStatus(B_NO_INIT) {}
+		BEntry(const char* path) { SetTo(path); }
+		BEntry(const BDirectory* directory, const char* name);
+
+		status_t SetTo(const char* path);
+		status_t InitCheck() const { return fStatus; }
+
+		bool Exists() const;
+		bool IsDirectory() const;
+
+		status_t GetName(char* buffer) const;
+		status_t GetPath(BPath* path) const;
+		status_t GetRef(entry_ref* ref) const;
+
+		const char* Path() const { return fPath.c_str(); }
+
+	private:
+		std::string	fPath;
+		status_t	fStatus;
+};
+
+#endif	// _ENTRY_H
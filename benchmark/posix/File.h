@@ -0,0 +1,38 @@
+/* File - Haiku's BFile, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _FILE_H
+#define _FILE_H
+
+
+#include <DataIO.h>
+#include <Node.h>
+
+
+class BFile : public BNode, public BPositionIO {
+	public:
+		BFile() : fFD(-1) {}
+		BFile(const BEntry* entry, uint32 openMode);
+		BFile(const char* path, uint32 openMode);
+		virtual ~BFile();
+
+		status_t SetTo(const char* path, uint32 openMode);
+
+		virtual ssize_t ReadAt(off_t position, void* buffer, size_t size);
+		virtual ssize_t WriteAt(off_t position, const void* buffer,
+							size_t size);
+
+		virtual off_t Seek(off_t position, uint32 seekMode);
+		virtual off_t Position() const;
+
+		virtual status_t GetSize(off_t* _size) const;
+
+	private:
+		BFile(const BFile&);
+		BFile& operator=(const BFile&);
+
+		int			fFD;
+};
+
+#endif	// _FILE_H
@@ -0,0 +1,31 @@
+/* Message - the subset of Haiku's BMessage that the album library uses
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _MESSAGE_H
+#define _MESSAGE_H
+
+
+#include <Entry.h>
+
+#include <map>
+#include <vector>
+
+
+/*!	Can only hold entry_refs. */
+class BMessage {
+	public:
+		status_t AddRef(const char* name, const entry_ref* ref);
+		status_t FindRef(const char* name, entry_ref* ref) const
+			{ return FindRef(name, 0, ref); }
+		status_t FindRef(const char* name, int32 index, entry_ref* ref) const;
+		status_t GetInfo(const char* name, type_code* _type,
+					int32* _count) const;
+
+	private:
+		typedef std::map<std::string, std::vector<entry_ref> > RefMap;
+
+		RefMap		fRefs;
+};
+
+#endif	// _MESSAGE_H
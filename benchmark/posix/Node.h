@@ -0,0 +1,45 @@
+/* Node - Haiku's BNode, with its attributes stored as extended attributes
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _NODE_H
+#define _NODE_H
+
+
+#include <Entry.h>
+
+
+struct attr_info {
+	uint32	type;
+	off_t	size;
+};
+
+
+/*!	An attribute "<name>" lives in the extended attribute "user.haiku.<name>",
+	which contains its type code in big endian, followed by its data; this
+	is what benchmark/generate_library writes, too.
+*/
+class BNode {
+	public:
+		BNode() : fStatus(B_NO_INIT) {}
+		BNode(const char* path) { SetTo(path); }
+		BNode(const BEntry* entry)
+			{ SetTo(entry != NULL ? entry->Path() : NULL); }
+		virtual ~BNode() {}
+
+		status_t SetTo(const char* path);
+		status_t InitCheck() const { return fStatus; }
+
+		ssize_t ReadAttr(const char* name, type_code type, off_t position,
+					void* buffer, size_t size) const;
+		ssize_t WriteAttr(const char* name, type_code type, off_t position,
+					const void* buffer, size_t size);
+		status_t RemoveAttr(const char* name);
+		status_t GetAttrInfo(const char* name, attr_info* info) const;
+
+	protected:
+		std::string	fPath;
+		status_t	fStatus;
+};
+
+#endif	// _NODE_H
@@ -0,0 +1,25 @@
+/* NodeInfo - Haiku's BNodeInfo, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _NODE_INFO_H
+#define _NODE_INFO_H
+
+
+#include <Node.h>
+
+
+class BNodeInfo {
+	public:
+		BNodeInfo(BNode* node) : fNode(node) {}
+
+		status_t InitCheck() const
+			{ return fNode != NULL ? fNode->InitCheck() : B_NO_INIT; }
+
+		status_t GetType(char* type) const;
+
+	private:
+		BNode*		fNode;
+};
+
+#endif	// _NODE_INFO_H
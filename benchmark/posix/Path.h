@@ -0,0 +1,31 @@
+/* Path - Haiku's BPath, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _PATH_H
+#define _PATH_H
+
+
+#include <Entry.h>
+
+
+class BPath {
+	public:
+		BPath() : fStatus(B_NO_INIT) {}
+		BPath(const char* directory, const char* leaf = NULL)
+			{ SetTo(directory, leaf); }
+		BPath(const entry_ref* ref)
+			{ SetTo(ref != NULL ? ref->path.c_str() : NULL); }
+
+		status_t SetTo(const char* directory, const char* leaf = NULL);
+		status_t InitCheck() const { return fStatus; }
+
+		const char* Path() const
+			{ return fStatus == B_OK ? fPath.c_str() : NULL; }
+
+	private:
+		std::string	fPath;
+		status_t	fStatus;
+};
+
+#endif	// _PATH_H
@@ -0,0 +1,648 @@
+/* Storage - the parts of Haiku's Storage and Support Kit used by the album
+ *		library, on top of POSIX and extended attributes
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ *
+ * This is not meant to behave like Haiku in every detail, only enough of
+ * it for AlbumAggregator.cpp and benchmark/scan_library.cpp to run over a
+ * library written by benchmark/generate_library on a system without BFS.
+ */
+
+
+#include <ByteOrder.h>
+#include <DataIO.h>
+#include <Directory.h>
+#include <Entry.h>
+#include <File.h>
+#include <Message.h>
+#include <Node.h>
+#include <NodeInfo.h>
+#include <Path.h>
+#include <String.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <vector>
+
+
+static status_t
+error_status(int error)
+{
+	return error == ENODATA ? B_ENTRY_NOT_FOUND : -error;
+}
+
+
+static void
+attribute_name(const char* name, char* buffer, size_t size)
+{
+	snprintf(buffer, size, "user.haiku.%s", name);
+}
+
+
+/*!	Reads the whole extended attribute of the given Haiku attribute,
+	including its type code.
+*/
+static status_t
+read_attribute(const std::string& path, const char* name,
+	std::vector<uint8>& value)
+{
+	char attribute[B_ATTR_NAME_LENGTH + 16];
+	attribute_name(name, attribute, sizeof(attribute));
+
+	ssize_t length = getxattr(path.c_str(), attribute, NULL, 0);
+	if (length < 4)
+		return length < 0 ? error_status(errno) : B_BAD_DATA;
+
+	value.resize(length);
+	length = getxattr(path.c_str(), attribute, &value[0], length);
+	if (length < 4)
+		return length < 0 ? error_status(errno) : B_BAD_DATA;
+
+	value.resize(length);
+	return B_OK;
+}
+
+
+//	#pragma mark - BString
+
+
+BString::BString(const char* string, int32 maxLength)
+{
+	if (string != NULL)
+		fString.assign(string, strnlen(string, maxLength));
+}
+
+
+BString&
+BString::operator=(const char* string)
+{
+	fString = string != NULL ? string : "";
+	return *this;
+}
+
+
+//	#pragma mark - BPositionIO
+
+
+BDataIO::~BDataIO()
+{
+}
+
+
+ssize_t
+BPositionIO::Read(void* buffer, size_t size)
+{
+	off_t position = Position();
+	ssize_t bytesRead = ReadAt(position, buffer, size);
+	if (bytesRead > 0)
+		Seek(position + bytesRead, SEEK_SET);
+
+	return bytesRead;
+}
+
+
+ssize_t
+BPositionIO::Write(const void* buffer, size_t size)
+{
+	off_t position = Position();
+	ssize_t bytesWritten = WriteAt(position, buffer, size);
+	if (bytesWritten > 0)
+		Seek(position + bytesWritten, SEEK_SET);
+
+	return bytesWritten;
+}
+
+
+status_t
+BPositionIO::SetSize(off_t)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+status_t
+BPositionIO::GetSize(off_t* _size) const
+{
+	BPositionIO* self = const_cast<BPositionIO*>(this);
+	off_t position = self->Position();
+	*_size = self->Seek(0, SEEK_END);
+	self->Seek(position, SEEK_SET);
+	return *_size >= 0 ? B_OK : B_ERROR;
+}
+
+
+BMemoryIO::BMemoryIO(const void* buffer, size_t size)
+	:
+	fBuffer((const uint8*)buffer),
+	fSize(size),
+	fPosition(0)
+{
+}
+
+
+ssize_t
+BMemoryIO::ReadAt(off_t position, void* buffer, size_t size)
+{
+	if (position < 0)
+		return B_BAD_VALUE;
+	if ((size_t)position >= fSize)
+		return 0;
+
+	if (size > fSize - position)
+		size = fSize - position;
+
+	memcpy(buffer, fBuffer + position, size);
+	return size;
+}
+
+
+ssize_t
+BMemoryIO::WriteAt(off_t, const void*, size_t)
+{
+	return B_NOT_ALLOWED;
+}
+
+
+off_t
+BMemoryIO::Seek(off_t position, uint32 seekMode)
+{
+	switch (seekMode) {
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			position += fPosition;
+			break;
+		case SEEK_END:
+			position += fSize;
+			break;
+		default:
+			return B_BAD_VALUE;
+	}
+
+	if (position < 0)
+		return B_BAD_VALUE;
+
+	fPosition = position;
+	return fPosition;
+}
+
+
+status_t
+BMemoryIO::GetSize(off_t* _size) const
+{
+	*_size = fSize;
+	return B_OK;
+}
+
+
+//	#pragma mark - BEntry, BPath
+
+
+BEntry::BEntry(const BDirectory* directory, const char* name)
+{
+	if (directory == NULL || name == NULL) {
+		fStatus = B_BAD_VALUE;
+		return;
+	}
+
+	BPath path(directory->Path(), name);
+	SetTo(path.Path());
+}
+
+
+status_t
+BEntry::SetTo(const char* path)
+{
+	if (path == NULL)
+		return fStatus = B_BAD_VALUE;
+
+	fPath = path;
+	return fStatus = B_OK;
+}
+
+
+bool
+BEntry::Exists() const
+{
+	struct stat stat;
+	return fStatus == B_OK && lstat(fPath.c_str(), &stat) == 0;
+}
+
+
+bool
+BEntry::IsDirectory() const
+{
+	struct stat stat;
+	return fStatus == B_OK && lstat(fPath.c_str(), &stat) == 0
+		&& S_ISDIR(stat.st_mode);
+}
+
+
+status_t
+BEntry::GetName(char* buffer) const
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	size_t slash = fPath.rfind('/');
+	std::string name = slash == std::string::npos
+		? fPath : fPath.substr(slash + 1);
+	if (name.length() >= B_FILE_NAME_LENGTH)
+		return B_BAD_VALUE;
+
+	strcpy(buffer, name.c_str());
+	return B_OK;
+}
+
+
+status_t
+BEntry::GetPath(BPath* path) const
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	return path->SetTo(fPath.c_str());
+}
+
+
+status_t
+BEntry::GetRef(entry_ref* ref) const
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	ref->path = fPath;
+	return B_OK;
+}
+
+
+status_t
+BPath::SetTo(const char* directory, const char* leaf)
+{
+	if (directory == NULL)
+		return fStatus = B_BAD_VALUE;
+
+	fPath = directory;
+	if (leaf != NULL) {
+		if (fPath.empty() || fPath[fPath.length() - 1] != '/')
+			fPath += '/';
+		fPath += leaf;
+	}
+	if (fPath.length() >= B_PATH_NAME_LENGTH)
+		return fStatus = B_NAME_TOO_LONG;
+
+	return fStatus = B_OK;
+}
+
+
+//	#pragma mark - BNode
+
+
+status_t
+BNode::SetTo(const char* path)
+{
+	if (path == NULL)
+		return fStatus = B_BAD_VALUE;
+
+	struct stat stat;
+	if (::stat(path, &stat) != 0)
+		return fStatus = error_status(errno);
+
+	fPath = path;
+	return fStatus = B_OK;
+}
+
+
+ssize_t
+BNode::ReadAttr(const char* name, type_code, off_t position, void* buffer,
+	size_t size) const
+{
+	if (fStatus != B_OK)
+		return fStatus;
+	if (position < 0)
+		return B_BAD_VALUE;
+
+	std::vector<uint8> value;
+	status_t status = read_attribute(fPath, name, value);
+	if (status != B_OK)
+		return status;
+
+	// skip the type code
+	size_t dataSize = value.size() - 4;
+	if ((size_t)position >= dataSize)
+		return 0;
+	if (size > dataSize - position)
+		size = dataSize - position;
+
+	memcpy(buffer, &value[4 + position], size);
+	return size;
+}
+
+
+ssize_t
+BNode::WriteAttr(const char* name, type_code type, off_t position,
+	const void* buffer, size_t size)
+{
+	if (fStatus != B_OK)
+		return fStatus;
+	if (position != 0)
+		return B_NOT_SUPPORTED;
+
+	char attribute[B_ATTR_NAME_LENGTH + 16];
+	attribute_name(name, attribute, sizeof(attribute));
+
+	std::vector<uint8> value(4 + size);
+	uint32 bigType = B_HOST_TO_BENDIAN_INT32(type);
+	memcpy(&value[0], &bigType, 4);
+	if (size > 0)
+		memcpy(&value[4], buffer, size);
+
+	if (setxattr(fPath.c_str(), attribute, &value[0], value.size(), 0) != 0)
+		return error_status(errno);
+
+	return size;
+}
+
+
+status_t
+BNode::RemoveAttr(const char* name)
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	char attribute[B_ATTR_NAME_LENGTH + 16];
+	attribute_name(name, attribute, sizeof(attribute));
+
+	if (removexattr(fPath.c_str(), attribute) != 0)
+		return error_status(errno);
+
+	return B_OK;
+}
+
+
+status_t
+BNode::GetAttrInfo(const char* name, attr_info* info) const
+{
+	if (fStatus != B_OK)
+		return fStatus;
+
+	std::vector<uint8> value;
+	status_t status = read_attribute(fPath, name, value);
+	if (status != B_OK)
+		return status;
+
+	uint32 type;
+	memcpy(&type, &value[0], 4);
+
+	info->type = B_BENDIAN_TO_HOST_INT32(type);
+	info->size = value.size() - 4;
+	return B_OK;
+}
+
+
+status_t
+BNodeInfo::GetType(char* type) const
+{
+	status_t status = InitCheck();
+	if (status != B_OK)
+		return status;
+
+	ssize_t bytesRead = fNode->ReadAttr("BEOS:TYPE", B_MIME_STRING_TYPE, 0,
+		type, B_MIME_TYPE_LENGTH - 1);
+	if (bytesRead < 0)
+		return bytesRead;
+	if (bytesRead == 0)
+		return B_ENTRY_NOT_FOUND;
+
+	type[bytesRead] = '\0';
+	return B_OK;
+}
+
+
+//	#pragma mark - BFile
+
+
+BFile::BFile(const BEntry* entry, uint32 openMode)
+	:
+	fFD(-1)
+{
+	SetTo(entry != NULL ? entry->Path() : NULL, openMode);
+}
+
+
+BFile::BFile(const char* path, uint32 openMode)
+	:
+	fFD(-1)
+{
+	SetTo(path, openMode);
+}
+
+
+BFile::~BFile()
+{
+	if (fFD >= 0)
+		close(fFD);
+}
+
+
+status_t
+BFile::SetTo(const char* path, uint32 openMode)
+{
+	if (fFD >= 0) {
+		close(fFD);
+		fFD = -1;
+	}
+
+	status_t status = BNode::SetTo(path);
+	if (status != B_OK)
+		return status;
+
+	fFD = open(path, openMode);
+	if (fFD < 0)
+		return fStatus = error_status(errno);
+
+	return B_OK;
+}
+
+
+ssize_t
+BFile::ReadAt(off_t position, void* buffer, size_t size)
+{
+	if (fFD < 0)
+		return B_NO_INIT;
+
+	ssize_t bytesRead = pread(fFD, buffer, size, position);
+	return bytesRead >= 0 ? bytesRead : error_status(errno);
+}
+
+
+ssize_t
+BFile::WriteAt(off_t position, const void* buffer, size_t size)
+{
+	if (fFD < 0)
+		return B_NO_INIT;
+
+	ssize_t bytesWritten = pwrite(fFD, buffer, size, position);
+	return bytesWritten >= 0 ? bytesWritten : error_status(errno);
+}
+
+
+off_t
+BFile::Seek(off_t position, uint32 seekMode)
+{
+	if (fFD < 0)
+		return B_NO_INIT;
+
+	off_t result = lseek(fFD, position, seekMode);
+	return result >= 0 ? result : error_status(errno);
+}
+
+
+off_t
+BFile::Position() const
+{
+	if (fFD < 0)
+		return B_NO_INIT;
+
+	return lseek(fFD, 0, SEEK_CUR);
+}
+
+
+status_t
+BFile::GetSize(off_t* _size) const
+{
+	struct stat stat;
+	if (fFD < 0)
+		return B_NO_INIT;
+	if (fstat(fFD, &stat) != 0)
+		return error_status(errno);
+
+	*_size = stat.st_size;
+	return B_OK;
+}
+
+
+//	#pragma mark - BDirectory
+
+
+BDirectory::BDirectory(const char* path)
+	:
+	fDirectory(NULL)
+{
+	if (BNode::SetTo(path) == B_OK)
+		_Open();
+}
+
+
+BDirectory::BDirectory(const BEntry* entry)
+	:
+	fDirectory(NULL)
+{
+	if (BNode::SetTo(entry != NULL ? entry->Path() : NULL) == B_OK)
+		_Open();
+}
+
+
+BDirectory::~BDirectory()
+{
+	if (fDirectory != NULL)
+		closedir(fDirectory);
+}
+
+
+void
+BDirectory::_Open()
+{
+	fDirectory = opendir(fPath.c_str());
+	if (fDirectory == NULL)
+		fStatus = error_status(errno);
+}
+
+
+status_t
+BDirectory::GetNextEntry(BEntry* entry, bool)
+{
+	if (fDirectory == NULL)
+		return B_NO_INIT;
+
+	while (struct dirent* dirent = readdir(fDirectory)) {
+		if (!strcmp(dirent->d_name, ".") || !strcmp(dirent->d_name, ".."))
+			continue;
+
+		BPath path(fPath.c_str(), dirent->d_name);
+		return entry->SetTo(path.Path());
+	}
+
+	return B_ENTRY_NOT_FOUND;
+}
+
+
+status_t
+BDirectory::Rewind()
+{
+	if (fDirectory == NULL)
+		return B_NO_INIT;
+
+	rewinddir(fDirectory);
+	return B_OK;
+}
+
+
+int32
+BDirectory::CountEntries()
+{
+	if (Rewind() != B_OK)
+		return 0;
+
+	int32 count = 0;
+	BEntry entry;
+	while (GetNextEntry(&entry) == B_OK)
+		count++;
+
+	Rewind();
+	return count;
+}
+
+
+//	#pragma mark - BMessage
+
+
+status_t
+BMessage::AddRef(const char* name, const entry_ref* ref)
+{
+	fRefs[name].push_back(*ref);
+	return B_OK;
+}
+
+
+status_t
+BMessage::FindRef(const char* name, int32 index, entry_ref* ref) const
+{
+	RefMap::const_iterator found = fRefs.find(name);
+	if (found == fRefs.end() || index < 0
+		|| (size_t)index >= found->second.size())
+		return B_ENTRY_NOT_FOUND;
+
+	*ref = found->second[index];
+	return B_OK;
+}
+
+
+status_t
+BMessage::GetInfo(const char* name, type_code* _type, int32* _count) const
+{
+	RefMap::const_iterator found = fRefs.find(name);
+	if (found == fRefs.end())
+		return B_ENTRY_NOT_FOUND;
+
+	if (_type != NULL)
+		*_type = 0x52524546;
+			// 'RREF'
+	if (_count != NULL)
+		*_count = found->second.size();
+	return B_OK;
+}
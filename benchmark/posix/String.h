@@ -0,0 +1,36 @@
+/* String - the subset of Haiku's BString that the album library uses
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ */
+#ifndef _B_STRING_H
+#define _B_STRING_H
+
+
+#include <SupportDefs.h>
+
+#include <string>
+
+
+class BString {
+	public:
+		BString() {}
+		BString(const char* string) : fString(string != NULL ? string : "") {}
+		BString(const char* string, int32 maxLength);
+
+		BString& operator=(const char* string);
+
+		const char* String() const { return fString.c_str(); }
+		int32 Length() const { return fString.length(); }
+
+		bool operator<(const BString& other) const
+			{ return fString < other.fString; }
+		bool operator==(const BString& other) const
+			{ return fString == other.fString; }
+		bool operator!=(const BString& other) const
+			{ return fString != other.fString; }
+
+	private:
+		std::string	fString;
+};
+
+#endif	// _B_STRING_H
@@ -0,0 +1,67 @@
+/* SupportDefs - the types and constants of Haiku's Support Kit, for POSIX
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ *
+ * This directory stands in for the parts of the Haiku API that the album
+ * library uses, so that it can be built and measured on other systems.
+ * See Storage.cpp.
+ */
+#ifndef _SUPPORT_DEFS_H
+#define _SUPPORT_DEFS_H
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+typedef int8_t		int8;
+typedef uint8_t		uint8;
+typedef int16_t		int16;
+typedef uint16_t	uint16;
+typedef int32_t		int32;
+typedef uint32_t	uint32;
+typedef int64_t		int64;
+typedef uint64_t	uint64;
+
+typedef int32		status_t;
+typedef uint32		type_code;
+typedef int64		bigtime_t;
+
+#define B_PRId32	PRId32
+#define B_PRId64	PRId64
+
+// the errors are negative error numbers, so that strerror(-status) works
+enum {
+	B_OK				= 0,
+	B_ERROR				= -1,
+	B_NO_MEMORY			= -ENOMEM,
+	B_IO_ERROR			= -EIO,
+	B_BAD_VALUE			= -EINVAL,
+	B_BAD_DATA			= -EILSEQ,
+	B_NOT_ALLOWED		= -EACCES,
+	B_NOT_SUPPORTED		= -EOPNOTSUPP,
+	B_ENTRY_NOT_FOUND	= -ENOENT,
+	B_NAME_TOO_LONG		= -ENAMETOOLONG,
+	B_NO_INIT			= -ENXIO
+};
+
+// 'CSTR', 'LONG', and 'MIMS'
+enum {
+	B_STRING_TYPE		= 0x43535452,
+	B_INT32_TYPE		= 0x4c4f4e47,
+	B_MIME_STRING_TYPE	= 0x4d494d53
+};
+
+#define B_FILE_NAME_LENGTH		256
+#define B_PATH_NAME_LENGTH		1024
+#define B_ATTR_NAME_LENGTH		256
+#define B_MIME_TYPE_LENGTH		(B_ATTR_NAME_LENGTH - 15)
+
+#define B_READ_ONLY				O_RDONLY
+#define B_READ_WRITE			O_RDWR
+
+#endif	// _SUPPORT_DEFS_H
@@ -0,0 +1,146 @@
+#!/bin/sh
+# run_benchmark.sh - measures the albumattr throughput on a synthetic library
+#
+# Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+#
+# Generates (once) a reproducible library with generate_library, and runs
+# albumattr over it twice: first with a cold, then with a warm file cache.
+# For each run, the albums and tracks per second are computed from the
+# --stats=json summary of albumattr.
+#
+# albumattr only runs on Haiku; elsewhere, scan_library is built and
+# measured instead. It runs the album library over the same tree, with
+# the attributes kept in "user.haiku.*" extended attributes by the
+# stand-ins in posix/, and leaves out the Media Kit and the icons; it
+# needs TagLib (found with pkg-config).
+# The cold run drops the file cache with DROP_CACHES if set, or through
+# /proc/sys/vm/drop_caches (as root) on Linux. Haiku has no way to just
+# drop the cache, so set DROP_CACHES to a command that does it there (for
+# example unmounting and mounting the volume again), or the cold run is
+# skipped.
+
+albums=1000
+seed=1
+albumattr=
+options="-r -f -d"
+library=
+
+here=`dirname "$0"`
+
+usage()
+{
+	echo "Usage: $0 [-a albums] [-s seed] [-b albumattr] [-o \"options\"] [library]" >&2
+	exit 1
+}
+
+while getopts "a:s:b:o:" option; do
+	case $option in
+		a)	albums=$OPTARG ;;
+		s)	seed=$OPTARG ;;
+		b)	albumattr=$OPTARG ;;
+		o)	options=$OPTARG ;;
+		*)	usage ;;
+	esac
+done
+shift `expr $OPTIND - 1`
+
+if [ $# -gt 1 ]; then
+	usage
+fi
+library=${1:-/tmp/albumattr-library-$albums-$seed}
+
+# build the generator if necessary
+
+generator="$here/generate_library"
+if [ ! -x "$generator" ] || [ "$here/generate_library.cpp" -nt "$generator" ]; then
+	${CXX:-c++} -O2 -Wall -Wextra -Wno-multichar -o "$generator" "$here/generate_library.cpp" \
+		|| exit 1
+fi
+
+if [ ! -d "$library" ]; then
+	"$generator" -a $albums -s $seed "$library" || exit 1
+fi
+
+# build the stand-in for albumattr if necessary
+
+if [ -z "$albumattr" ] && [ "`uname -s`" = Haiku ]; then
+	albumattr=albumattr
+elif [ -z "$albumattr" ]; then
+	albumattr="$here/scan_library"
+	sources="../AlbumAggregator.cpp ../Arena.cpp ../EmbeddedCover.cpp
+		../TailTags.cpp posix/Storage.cpp scan_library.cpp"
+	rebuild=
+	for source in $sources; do
+		if [ "$here/$source" -nt "$albumattr" ]; then
+			rebuild=1
+		fi
+	done
+	if [ ! -x "$albumattr" ] || [ -n "$rebuild" ]; then
+		taglib=`pkg-config --cflags --libs taglib` || {
+			echo "$0: TagLib is needed to build $albumattr" >&2
+			exit 1
+		}
+		(cd "$here" && ${CXX:-c++} -O2 -Wall -Wno-multichar -Iposix -I.. \
+			-o scan_library $sources $taglib) || exit 1
+	fi
+fi
+
+drop_caches()
+{
+	sync
+	if [ -n "$DROP_CACHES" ]; then
+		sh -c "$DROP_CACHES"
+	elif [ -w /proc/sys/vm/drop_caches ]; then
+		echo 3 > /proc/sys/vm/drop_caches
+	else
+		return 1
+	fi
+}
+
+# extracts a number from the JSON summary
+json_value()
+{
+	sed -n "s/.*\"$1\": \([0-9]*\).*/\1/p" "$2"
+}
+
+run()
+{
+	name=$1
+	statsFile=`mktemp`
+
+	$albumattr $options --stats=json "$library" 2> "$statsFile" > /dev/null
+	summary=`grep '^{"total_us"' "$statsFile"`
+	if [ -z "$summary" ]; then
+		echo "$name: albumattr did not produce statistics" >&2
+		cat "$statsFile" >&2
+		rm -f "$statsFile"
+		return 1
+	fi
+
+	echo "$summary" > "$statsFile"
+	total=`json_value total_us "$statsFile"`
+	albumCount=`json_value albums "$statsFile"`
+	trackCount=`json_value "audio files" "$statsFile"`
+	rm -f "$statsFile"
+
+	awk -v name="$name" -v total="$total" -v albums="$albumCount" \
+		-v tracks="$trackCount" 'BEGIN {
+			seconds = total / 1000000.0;
+			if (seconds <= 0)
+				seconds = 0.000001;
+			printf("%-6s %8.2f s %8d albums %8.1f albums/s %8d tracks %9.1f tracks/s\n",
+				name, seconds, albums, albums / seconds, tracks,
+				tracks / seconds);
+		}'
+}
+
+echo "library: $library"
+echo "command: $albumattr $options"
+
+if drop_caches; then
+	run cold
+else
+	echo "cold:  skipped, cannot drop the file cache (see DROP_CACHES)" >&2
+fi
+
+run warm
@@ -0,0 +1,201 @@
+/* scan_library - the album scan of albumattr, for systems without BFS
+ *
+ * Copyright (c) 2003-2018 pinc Software. All Rights Reserved.
+ *
+ * Walks a library like "albumattr -r" does, lets the album library decide
+ * which directories are albums, and writes their Album:* attributes. It is
+ * built against the stand-ins in benchmark/posix, which keep the attributes
+ * in "user.haiku.*" extended attributes, so that run_benchmark.sh can
+ * measure the library path on a plain Linux box.
+ * The Media Kit and the icons are not available there: the lengths are the
+ * ones the songs have in their attributes or tail tags, and no cover is
+ * decoded.
+ */
+
+
+#include "AlbumAggregator.h"
+
+#include <Directory.h>
+#include <Entry.h>
+#include <Node.h>
+#include <Path.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+static const char *kAlbumMimeString = "application/x-vnd.Be-directory-album";
+
+bool gRecursive = false;
+bool gForce = false;
+bool gVerbose = false;
+bool gJSONStats = false;
+
+int64 gAlbums = 0;
+int64 gAudioFiles = 0;
+int64 gAttributesWritten = 0;
+
+
+static bigtime_t
+system_time()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+
+static void
+writeAttributeString(BNode &node, const char *attribute, const char *value)
+{
+	if (!gForce) {
+		attr_info attrInfo;
+		if (node.GetAttrInfo(attribute, &attrInfo) == B_OK)
+			return;
+	}
+
+	if (node.WriteAttr(attribute, B_STRING_TYPE, 0, value,
+			strlen(value) + 1) >= 0)
+		gAttributesWritten++;
+}
+
+
+/*!	Writes the attributes like albumattr's handleDirectory() does; the
+	lengths and years are formatted the same way.
+*/
+static void
+writeAlbum(const char *path, const album_record &album)
+{
+	BNode node(path);
+	if (node.InitCheck() != B_OK)
+		return;
+
+	node.WriteAttr("BEOS:TYPE", B_MIME_STRING_TYPE, 0, kAlbumMimeString,
+		strlen(kAlbumMimeString) + 1);
+
+	writeAttributeString(node, "Album:Artist", album.artist.String());
+	writeAttributeString(node, "Album:Title", album.album.String());
+	writeAttributeString(node, "Album:Genre", album.genre.String());
+
+	char buffer[64];
+	sprintf(buffer, "%02" B_PRId32 ":%02" B_PRId32, album.length / 60,
+		album.length % 60);
+	writeAttributeString(node, "Album:Length", buffer);
+
+	if (album.min_year != 0 && album.max_year != 0) {
+		if (album.min_year == album.max_year)
+			sprintf(buffer, "%4" B_PRId32, album.min_year);
+		else {
+			sprintf(buffer, "%4" B_PRId32 "-%4" B_PRId32, album.min_year,
+				album.max_year);
+		}
+		writeAttributeString(node, "Album:Year", buffer);
+	}
+}
+
+
+static void
+scanDirectory(const char *path, const aggregator_options &options)
+{
+	album_record album;
+	status_t status = aggregate_directory(path, options, album);
+	if (status != B_OK) {
+		fprintf(stderr, "Could not scan \"%s\": %s\n", path, strerror(-status));
+		return;
+	}
+
+	gAudioFiles += album.tracks;
+
+	if (album.verdict == kAlbumAccepted) {
+		gAlbums++;
+		writeAlbum(path, album);
+
+		if (gVerbose) {
+			printf("%s: %s - %s (%" B_PRId32 " tracks)\n", path,
+				album.artist.String(), album.album.String(), album.tracks);
+		}
+	}
+
+	if (!gRecursive)
+		return;
+
+	BDirectory directory(path);
+	BEntry entry;
+	while (directory.GetNextEntry(&entry) == B_OK) {
+		if (entry.IsDirectory())
+			scanDirectory(entry.Path(), options);
+	}
+}
+
+
+static void
+printUsage(const char *cmd)
+{
+	fprintf(stderr, "usage: %s [-rfdv] [--stats=json] <list of directories>\n"
+		"  -r\tenter directories recursively\n"
+		"  -f\tforce overwriting existing attributes\n"
+		"  -d\tallow different artists in one album\n"
+		"  -v\tverbose mode\n"
+		"  --stats=json\tprint a summary like albumattr's to stderr\n", cmd);
+}
+
+
+int
+main(int argc, char **argv)
+{
+	const char *cmd = argv[0];
+	aggregator_options options;
+	// like albumattr without "-c", image files are not looked at
+	options.find_cover_image = false;
+
+	while (*++argv && **argv == '-') {
+		if ((*argv)[1] == '-') {
+			if (strcmp(*argv + 2, "stats=json")) {
+				printUsage(cmd);
+				return 1;
+			}
+			gJSONStats = true;
+			continue;
+		}
+
+		for (int i = 1; (*argv)[i]; i++) {
+			switch ((*argv)[i]) {
+				case 'r':
+					gRecursive = true;
+					break;
+				case 'f':
+					gForce = true;
+					break;
+				case 'd':
+					options.allow_mixed = true;
+					break;
+				case 'v':
+					gVerbose = true;
+					break;
+				default:
+					printUsage(cmd);
+					return 1;
+			}
+		}
+	}
+
+	if (*argv == NULL) {
+		printUsage(cmd);
+		return 1;
+	}
+
+	bigtime_t start = system_time();
+
+	for (; *argv; argv++)
+		scanDirectory(*argv, options);
+
+	if (gJSONStats) {
+		fprintf(stderr, "{\"total_us\": %lld, \"counters\": {\"albums\": %lld, "
+			"\"audio files\": %lld, \"attributes written\": %lld}}\n",
+			(long long)(system_time() - start), (long long)gAlbums,
+			(long long)gAudioFiles, (long long)gAttributesWritten);
+	}
+	return 0;
+}